@@ -0,0 +1,158 @@
+#include "batch.h"
+
+// Column-at-a-time evaluation of a straight-line numeric program. Rows are processed in blocks of
+// BLOCK_SIZE: the stack holds pointers to blocks instead of values, and each instruction runs one
+// tight loop over the block. The loops are plain C++, vectorized only by an optimizing build (-O3,
+// which CMakeLists.txt's default Release type gives); unoptimized they run a row at a time.
+// Comparisons produce 1.0 or 0.0.
+// Bytecode has no jumps, so every row runs every instruction and each print fills its column for
+// every row.
+
+BatchVM::BatchVM(const Program& program)
+    : program(program), inputs(program.variable_pool.size()), globals(program.variable_pool.size()),
+      global_blocks(program.variable_pool.size()), constants(program.constant_pool.size()),
+      scratch(program.max_stack), stack(program.max_stack) {
+    for (size_t i = 0; i < program.constant_pool.size(); i++) {
+        const lib::Value& constant = program.constant_pool[i];
+        double value = 0;
+        if (auto v = std::get_if<double>(&constant)) value = *v;
+        else if (auto v = std::get_if<bool>(&constant)) value = *v;
+        std::fill_n(constants[i].values, BLOCK_SIZE, value);
+    }
+    for (size_t i = 0; i < program.bytecode.size(); i += op_length(program.bytecode[i])) {
+        if (program.bytecode[i] == PRINT || program.bytecode[i] == PRINT_RETURN) outputs++;
+    }
+}
+
+BatchVM::~BatchVM() {}
+
+// Binds a variable to a column of inputs, one value per row. Reads of the variable see the row's
+// value until the program redefines it.
+void BatchVM::bind(size_t var_index, std::span<const double> column) {
+    inputs.at(var_index) = column;
+}
+
+// Only programs the Verifier proves well typed, given the bound inputs, and that never touch a
+// string can run a block at a time.
+void BatchVM::check() {
+    for (const lib::Value& constant : program.constant_pool) {
+        if (std::holds_alternative<lib::String>(constant)) throw std::runtime_error("Batch programs can only use numbers.");
+    }
+    // Equality compares types as well as values, which blocks of doubles can't tell apart
+    for (size_t i = 0; i < program.bytecode.size(); i += op_length(program.bytecode[i])) {
+        uint8_t op = program.bytecode[i];
+        if (op == EQEQ || op == BEQ) throw std::runtime_error("Batch programs can't compare for equality.");
+    }
+    Verifier verifier(program);
+    for (size_t v = 0; v < inputs.size(); v++) {
+        if (!inputs[v].empty()) verifier.bind_number(v);
+    }
+    if (!verifier.verify()) throw std::runtime_error("Batch program rejected: " + verifier.get_error());
+}
+
+std::vector<BatchVM::Column> BatchVM::execute(size_t rows) {
+    check();
+    for (size_t v = 0; v < inputs.size(); v++) {
+        if (!inputs[v].empty() && inputs[v].size() < rows) throw std::runtime_error("Input column shorter than the row count.");
+    }
+
+    std::vector<Column> columns(outputs);
+    for (Column& column : columns) column.reserve(rows);
+    for (size_t row = 0; row < rows; row += BLOCK_SIZE) {
+        run_block(row, std::min(BLOCK_SIZE, rows - row), columns);
+    }
+    return columns;
+}
+
+template <typename Op>
+static void kernel(double* out, const double* a, const double* b, size_t count, Op op) {
+    for (size_t k = 0; k < count; k++) out[k] = op(a[k], b[k]);
+}
+
+template <typename Op>
+static void scalar_kernel(double* out, const double* a, double b, size_t count, Op op) {
+    for (size_t k = 0; k < count; k++) out[k] = op(a[k], b);
+}
+
+static constexpr auto op_add = [](double a, double b) { return a + b; };
+static constexpr auto op_sub = [](double a, double b) { return a - b; };
+static constexpr auto op_mul = [](double a, double b) { return a * b; };
+static constexpr auto op_div = [](double a, double b) { return a / b; };
+static constexpr auto op_grt = [](double a, double b) { return double(a > b); };
+static constexpr auto op_grte = [](double a, double b) { return double(a >= b); };
+static constexpr auto op_lss = [](double a, double b) { return double(a < b); };
+static constexpr auto op_lsse = [](double a, double b) { return double(a <= b); };
+
+// Combines the two topmost blocks into the lower slot's result block.
+template <typename Op>
+void BatchVM::binary(size_t& depth, size_t count, Op op) {
+    double* result = scratch[depth - 2].values;
+    kernel(result, stack[depth - 2], stack[depth - 1], count, op);
+    stack[depth - 2] = result;
+    depth--;
+}
+
+template <typename Op>
+void BatchVM::binary_const(size_t& depth, size_t count, uint8_t index, Op op) {
+    double* result = scratch[depth - 1].values;
+    scalar_kernel(result, stack[depth - 1], constants[index].values[0], count, op);
+    stack[depth - 1] = result;
+}
+
+template <typename Op>
+void BatchVM::var_const(size_t& depth, size_t count, uint8_t var_index, uint8_t index, Op op) {
+    double* result = scratch[depth].values;
+    scalar_kernel(result, globals[var_index], constants[index].values[0], count, op);
+    stack[depth++] = result;
+}
+
+void BatchVM::run_block(size_t row, size_t count, std::vector<Column>& columns) {
+    const std::pmr::vector<uint8_t>& bytecode = program.bytecode;
+    for (size_t v = 0; v < inputs.size(); v++) {
+        if (!inputs[v].empty()) globals[v] = inputs[v].data() + row;
+    }
+
+    size_t depth = 0;
+    size_t column = 0;
+    for (size_t i = 0; i < bytecode.size(); i += op_length(bytecode[i]))
+    {
+        switch (bytecode[i])
+        {
+            case CON: stack[depth++] = constants[bytecode[i + 1]].values; break;
+            case VAR: stack[depth++] = globals[bytecode[i + 1]]; break;
+            case DEF: {
+                uint8_t var_index = bytecode[i + 1];
+                double* values = global_blocks[var_index].values;
+                const double* source = stack[--depth];
+                if (source != values) std::copy_n(source, count, values);
+                globals[var_index] = values;
+                break;
+            }
+            case ADD: case ADD_NUM: binary(depth, count, op_add); break;
+            case SUB: case SUB_NUM: binary(depth, count, op_sub); break;
+            case MUL: case MUL_NUM: binary(depth, count, op_mul); break;
+            case DIV: case DIV_NUM: binary(depth, count, op_div); break;
+            case GRT: case GRT_NUM: binary(depth, count, op_grt); break;
+            case GRTE: case GRTE_NUM: binary(depth, count, op_grte); break;
+            case LSS: case LSS_NUM: binary(depth, count, op_lss); break;
+            case LSSE: case LSSE_NUM: binary(depth, count, op_lsse); break;
+            case ADD_CONST: binary_const(depth, count, bytecode[i + 1], op_add); break;
+            case SUB_CONST: binary_const(depth, count, bytecode[i + 1], op_sub); break;
+            case MUL_CONST: binary_const(depth, count, bytecode[i + 1], op_mul); break;
+            case DIV_CONST: binary_const(depth, count, bytecode[i + 1], op_div); break;
+            case VAR_GRT_CONST: var_const(depth, count, bytecode[i + 1], bytecode[i + 2], op_grt); break;
+            case VAR_GRTE_CONST: var_const(depth, count, bytecode[i + 1], bytecode[i + 2], op_grte); break;
+            case VAR_LSS_CONST: var_const(depth, count, bytecode[i + 1], bytecode[i + 2], op_lss); break;
+            case VAR_LSSE_CONST: var_const(depth, count, bytecode[i + 1], bytecode[i + 2], op_lsse); break;
+            case PRINT: case PRINT_RETURN: {
+                const double* values = stack[--depth];
+                Column& output = columns[column++];
+                output.insert(output.end(), values, values + count);
+                if (bytecode[i] == PRINT_RETURN) depth = 0;
+                break;
+            }
+            case RETURN: depth = 0; break;
+            default: break;
+        }
+    }
+}
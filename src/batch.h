@@ -0,0 +1,46 @@
+#pragma once
+#include "compiler.h"
+#include "verifier.h"
+
+// Runs a numeric-only Program over many rows at once. Variables bound with bind() read a column of
+// doubles instead of a single value, and every instruction is applied to a whole block of rows
+// before moving on to the next instruction, so dispatch is paid once per block rather than once per
+// row. Each print in the program yields one output column.
+class BatchVM {
+    public:
+        static constexpr size_t BLOCK_SIZE = 1024;
+        using Column = std::vector<double>;
+
+    private:
+        struct alignas(64) Block {
+            double values[BLOCK_SIZE];
+        };
+
+        const Program& program;
+        std::vector<std::span<const double>> inputs;
+        // Where each variable's values for the current block live: its input column or its own block
+        std::vector<const double*> globals;
+        std::vector<Block> global_blocks;
+        // Each constant repeated across a block, so CON pushes a pointer like any other operand
+        std::vector<Block> constants;
+        // One result block per stack slot
+        std::vector<Block> scratch;
+        std::vector<const double*> stack;
+        size_t outputs = 0;
+
+        void check();
+        void run_block(size_t row, size_t count, std::vector<Column>& columns);
+        template <typename Op>
+        void binary(size_t& depth, size_t count, Op op);
+        template <typename Op>
+        void binary_const(size_t& depth, size_t count, uint8_t index, Op op);
+        template <typename Op>
+        void var_const(size_t& depth, size_t count, uint8_t var_index, uint8_t index, Op op);
+
+    public:
+        BatchVM(const Program& program);
+        ~BatchVM();
+
+        void bind(size_t var_index, std::span<const double> column);
+        std::vector<Column> execute(size_t rows);
+};
@@ -1,22 +1,353 @@
 #include "compiler.h"
+#include "verifier.h"
+#include <map>
+#include <numeric>
 
 // Takes the AST created by the parser and turns it into bytecode for the VM to process.
 
-Compiler::Compiler(const std::vector<std::unique_ptr<Expr>>& ast) : ast(ast) {}
+Compiler::Compiler(const std::pmr::vector<ExprPtr>& ast, std::pmr::memory_resource* resource)
+    : bytecode(resource), ast(&ast), constant_pool(resource), variable_pool(resource), variable_index(resource), lines(resource),
+      verifier(std::make_unique<Verifier>(bytecode, constant_pool, variable_pool)) {}
+
+// For streaming: statements are fed one at a time through compile_statement, then finish().
+Compiler::Compiler(std::pmr::memory_resource* resource)
+    : bytecode(resource), constant_pool(resource), variable_pool(resource), variable_index(resource), lines(resource),
+      verifier(std::make_unique<Verifier>(bytecode, constant_pool, variable_pool)) {}
 
 Compiler::~Compiler() {}
 
-std::vector<uint8_t> Compiler::compile() {
-    for (size_t i = 0; i < ast.size(); i++)
+// The line table entry covering offset. Instructions emitted before any line was known report 0.
+uint32_t Program::line_at(size_t offset) const {
+    auto run = std::upper_bound(lines.begin(), lines.end(), offset,
+        [](size_t offset, const LineRun& run) { return offset < run.offset; });
+    return run == lines.begin() ? 0 : std::prev(run)->line;
+}
+
+std::pmr::vector<uint8_t> Compiler::compile() {
+    for (size_t i = 0; i < ast->size(); i++)
     {
-        auto _ast = ast[i].get();
-        handler(_ast);
-        bytecode.push_back(RETURN);
+        compile_statement((*ast)[i].get());
     }
-    
+    return finish();
+}
+
+void Compiler::compile_statement(Expr* stmt) {
+    if (bytecode.size() == finished) {
+        kept_constants = constant_pool.size();
+        kept_variables = variable_pool.size();
+    }
+    handler(stmt);
+    mark_line(stmt->line);
+    bytecode.push_back(RETURN);
+}
+
+// Runs the whole-program passes over everything compiled since the last finish(), so a REPL can
+// keep appending statements to the same chunk.
+const std::pmr::vector<uint8_t>& Compiler::finish() {
+    if (optimize && provably_pure()) {
+        eliminate_dead_stores();
+        eliminate_common_subexpressions();
+    }
+    if (optimize) peephole();
+    compute_max_stack();
+    finished = bytecode.size();
+    kept_constants = constant_pool.size();
+    kept_variables = variable_pool.size();
+
     return bytecode;
 }
 
+// Drops statements compiled since the last finish(), e.g. after one of them failed to compile,
+// along with the constants and variables they added, so later statements can't refer to them.
+void Compiler::discard() {
+    bytecode.resize(finished);
+    while (!lines.empty() && lines.back().offset >= finished) lines.pop_back();
+    constant_pool.erase(constant_pool.begin() + kept_constants, constant_pool.end());
+    for (size_t i = kept_variables; i < variable_pool.size(); i++) variable_index.erase(variable_pool[i]);
+    variable_pool.erase(variable_pool.begin() + kept_variables, variable_pool.end());
+}
+
+// With optimizations off, finish() leaves the bytecode as compiled, e.g. to check the optimized
+// program against. Set before the first statement.
+void Compiler::set_optimize(bool enabled) {
+    optimize = enabled;
+}
+
+// Appends whatever program doesn't have yet. Code already in program is left alone, since the VM
+// may have rewritten it while running.
+void Compiler::link(Program& program) {
+    auto run = std::lower_bound(lines.begin(), lines.end(), program.bytecode.size(),
+        [](const LineRun& run, size_t offset) { return run.offset < offset; });
+    program.lines.insert(program.lines.end(), run, lines.end());
+    program.bytecode.insert(program.bytecode.end(), bytecode.begin() + program.bytecode.size(), bytecode.begin() + finished);
+    program.constant_pool.insert(program.constant_pool.end(), constant_pool.begin() + program.constant_pool.size(), constant_pool.end());
+    program.variable_pool.insert(program.variable_pool.end(), variable_pool.begin() + program.variable_pool.size(), variable_pool.end());
+    program.max_stack = max_stack;
+}
+
+// Whether the code compiled since the last finish() passes the Verifier, given the types earlier
+// code and bound globals left. If it does, no expression can throw, so evaluating one has no effect
+// besides its value and the dataflow passes may drop or share them. The optimizations only drop
+// overwritten stores and add temporaries nothing later reads, so the types the Verifier carries
+// over still hold for the rewritten code.
+bool Compiler::provably_pure() {
+    return verifier->verify(finished);
+}
+
+// Drops stores that are overwritten before anything reads them: `var x = e;` loses e and its DEF,
+// keeping the RETURN, since that prints the statement's line break. The last store to a variable
+// always stays, as a REPL's later lines or a snapshot can still read it.
+void Compiler::eliminate_dead_stores() {
+    // Replays the stack to find where each DEF's operand starts. A binary operator's result starts
+    // where its left operand did, so only the right operand is popped.
+    std::vector<size_t> starts;
+    std::unordered_map<size_t, size_t> operand;
+    std::vector<size_t> stack;
+    for (size_t i = finished; i < bytecode.size(); i += op_length(bytecode[i])) {
+        starts.push_back(i);
+        switch (bytecode[i]) {
+            case CON: case VAR: stack.push_back(i); break;
+            case DEF: operand[i] = stack.back(); stack.pop_back(); break;
+            case RETURN: stack.clear(); break;
+            default: stack.pop_back(); break;
+        }
+    }
+
+    // Walks backwards remembering whether each variable is next read or next overwritten
+    enum class Access { NONE, READ, WRITE };
+    std::vector<Access> next(variable_pool.size(), Access::NONE);
+    std::vector<Edit> edits;
+    size_t floor = SIZE_MAX;
+    for (auto it = starts.rbegin(); it != starts.rend(); ++it) {
+        size_t i = *it;
+        // Inside an expression that's being dropped, so its reads don't count
+        if (i >= floor) continue;
+        if (bytecode[i] == VAR) next[bytecode[i + 1]] = Access::READ;
+        if (bytecode[i] != DEF) continue;
+
+        uint8_t var_index = bytecode[i + 1];
+        if (next[var_index] == Access::WRITE) {
+            floor = operand[i];
+            edits.push_back({floor, i + op_length(DEF), {}});
+        }
+        next[var_index] = Access::WRITE;
+    }
+    std::reverse(edits.begin(), edits.end());
+    apply(edits);
+}
+
+// Computes a binary expression that occurs more than once a single time, keeps it in a hidden
+// global and reads that back at every later occurrence. Occurrences are the same value only until
+// one of the variables they read is redefined. A temporary costs a DEF and a VAR, so an expression
+// is only shared when it saves instructions overall, and larger expressions are shared first.
+void Compiler::eliminate_common_subexpressions() {
+    struct Group {
+        size_t length;
+        std::vector<std::pair<size_t, size_t>> occurrences;
+    };
+    struct Operand {
+        size_t start;
+        size_t length;
+        size_t number;
+    };
+    // An expression's value number is keyed on its opcode and its operands' numbers, or for a leaf
+    // on its operand byte. A VAR's key also has the variable's version, bumped by every DEF, so the
+    // same read after a redefinition gets a new number, and so does everything built from it.
+    struct Key {
+        uint8_t op;
+        size_t a;
+        size_t b;
+        bool operator==(const Key&) const = default;
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const noexcept {
+            size_t h = std::hash<size_t>{}(k.a) * 31 + std::hash<size_t>{}(k.b);
+            return h * 31 + k.op;
+        }
+    };
+    // Indexed by value number; leaves get a group too, but never any occurrences
+    std::vector<Group> groups;
+    std::unordered_map<Key, size_t, KeyHash> numbers;
+    std::vector<size_t> versions(variable_pool.size());
+    std::vector<Operand> stack;
+    auto number = [&](Key key, size_t length) {
+        auto [it, inserted] = numbers.try_emplace(key, groups.size());
+        if (inserted) groups.push_back({length, {}});
+        return it->second;
+    };
+
+    for (size_t i = finished; i < bytecode.size(); i += op_length(bytecode[i])) {
+        switch (bytecode[i]) {
+            case CON: stack.push_back({i, 1, number({CON, bytecode[i + 1], 0}, 1)}); break;
+            case VAR: stack.push_back({i, 1, number({VAR, bytecode[i + 1], versions[bytecode[i + 1]]}, 1)}); break;
+            case DEF: stack.pop_back(); versions[bytecode[i + 1]]++; break;
+            case PRINT: stack.pop_back(); break;
+            case RETURN: stack.clear(); break;
+            default: {
+                Operand right = stack.back();
+                stack.pop_back();
+                Operand& left = stack.back();
+                left.length += right.length + 1;
+                left.number = number({bytecode[i], left.number, right.number}, left.length);
+                groups[left.number].occurrences.push_back({left.start, i + 1});
+                break;
+            }
+        }
+    }
+
+    std::vector<size_t> order(groups.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return groups[a].length > groups[b].length; });
+
+    // Spans already rewritten, start -> end, kept disjoint so rewrites never nest
+    std::map<size_t, size_t> taken;
+    auto overlaps = [&](size_t start, size_t end) {
+        auto after = taken.lower_bound(start);
+        if (after != taken.end() && after->first < end) return true;
+        return after != taken.begin() && std::prev(after)->second > start;
+    };
+
+    std::vector<Edit> edits;
+    for (size_t g : order) {
+        std::vector<std::pair<size_t, size_t>> occurrences;
+        for (auto [start, end] : groups[g].occurrences) {
+            if (!overlaps(start, end)) occurrences.push_back({start, end});
+        }
+        if (occurrences.size() < 2 || (occurrences.size() - 1) * (groups[g].length - 1) <= 2) continue;
+        if (variable_pool.size() > UINT8_MAX) break;
+
+        uint8_t temp = static_cast<uint8_t>(add_variable(lib::intern(std::format("$cse{}", temporaries++))));
+        edits.push_back({occurrences[0].second, occurrences[0].second, {DEF, temp, VAR, temp}});
+        for (size_t k = 1; k < occurrences.size(); k++) {
+            edits.push_back({occurrences[k].first, occurrences[k].second, {VAR, temp}});
+        }
+        for (auto [start, end] : occurrences) taken[start] = end;
+    }
+    // An insertion sorts before a replacement starting at the same offset
+    std::sort(edits.begin(), edits.end(), [](const Edit& a, const Edit& b) {
+        return a.start != b.start ? a.start < b.start : a.end < b.end;
+    });
+    apply(edits);
+}
+
+// Rewrites the uncommitted part of the bytecode with edits, sorted and disjoint, and moves the line
+// table along. Code that was replaced reports the line of whatever took its place. Only the tail is
+// rebuilt, so the cost doesn't grow with everything committed before it.
+void Compiler::apply(std::vector<Edit>& edits) {
+    if (edits.empty()) return;
+    std::pmr::vector<uint8_t> out(bytecode.get_allocator());
+    out.reserve(bytecode.size() - finished);
+    // Where each tail offset, relative to finished, ends up, also relative to finished
+    std::vector<uint32_t> moved(bytecode.size() - finished + 1);
+
+    auto edit = edits.begin();
+    size_t i = finished;
+    while (i < bytecode.size()) {
+        if (edit != edits.end() && edit->start == i) {
+            for (size_t k = i; k < edit->end; k++) moved[k - finished] = static_cast<uint32_t>(out.size());
+            out.insert(out.end(), edit->replacement.begin(), edit->replacement.end());
+            i = edit->end;
+            ++edit;
+            continue;
+        }
+        moved[i - finished] = static_cast<uint32_t>(out.size());
+        out.insert(out.end(), bytecode.begin() + i, bytecode.begin() + i + op_length(bytecode[i]));
+        i += op_length(bytecode[i]);
+    }
+    // An insertion at the very end
+    for (; edit != edits.end(); ++edit) out.insert(out.end(), edit->replacement.begin(), edit->replacement.end());
+    moved[bytecode.size() - finished] = static_cast<uint32_t>(out.size());
+
+    std::vector<LineRun> tail(tail_runs(), lines.end());
+    lines.erase(tail_runs(), lines.end());
+    for (const LineRun& run : tail) {
+        uint32_t offset = static_cast<uint32_t>(finished + moved[run.offset - finished]);
+        if (!lines.empty() && lines.back().offset == offset) lines.pop_back();
+        if (lines.empty() || lines.back().line != run.line) lines.push_back({offset, run.line});
+    }
+    bytecode.resize(finished);
+    bytecode.insert(bytecode.end(), out.begin(), out.end());
+}
+
+// The first line table entry that starts in the uncommitted tail.
+std::pmr::vector<LineRun>::iterator Compiler::tail_runs() {
+    return std::lower_bound(lines.begin(), lines.end(), finished,
+        [](const LineRun& run, size_t offset) { return run.offset < offset; });
+}
+
+// Fuses the instruction sequences every script is made of into single superinstructions:
+//      CON c ADD           ->  ADD_CONST c         (same for SUB, MUL, DIV)
+//      VAR v CON c LSS     ->  VAR_LSS_CONST v c   (same for GRT, GRTE, LSSE)
+//      PRINT RETURN        ->  PRINT_RETURN
+// The bytecode has no jumps yet, so instructions can be shifted around freely. The line table is
+// rebuilt alongside; a fused instruction takes the line of the first instruction it replaces.
+void Compiler::peephole() {
+    std::pmr::vector<uint8_t> out(bytecode.get_allocator());
+    out.reserve(bytecode.size() - finished);
+    std::vector<LineRun> tail(tail_runs(), lines.end());
+    lines.erase(tail_runs(), lines.end());
+    size_t run = 0;
+
+    size_t i = finished;
+    while (i < bytecode.size()) {
+        if (run < tail.size() && tail[run].offset <= i) {
+            while (run + 1 < tail.size() && tail[run + 1].offset <= i) run++;
+            uint32_t line = tail[run++].line;
+            if (lines.empty() || lines.back().line != line) lines.push_back({static_cast<uint32_t>(finished + out.size()), line});
+        }
+        uint8_t op = bytecode[i];
+        uint8_t next = i + op_length(op) < bytecode.size() ? bytecode[i + op_length(op)] : static_cast<uint8_t>(RETURN);
+
+        if (op == VAR && next == CON && i + 4 < bytecode.size()) {
+            uint8_t fused = RETURN;
+            switch (bytecode[i + 4]) {
+                case GRT: fused = VAR_GRT_CONST; break;
+                case GRTE: fused = VAR_GRTE_CONST; break;
+                case LSS: fused = VAR_LSS_CONST; break;
+                case LSSE: fused = VAR_LSSE_CONST; break;
+            }
+            if (fused != RETURN) {
+                out.insert(out.end(), {fused, bytecode[i + 1], bytecode[i + 3]});
+                i += 5;
+                continue;
+            }
+        }
+        if (op == CON && i + 2 < bytecode.size()) {
+            uint8_t fused = RETURN;
+            switch (next) {
+                case ADD: fused = ADD_CONST; break;
+                case SUB: fused = SUB_CONST; break;
+                case MUL: fused = MUL_CONST; break;
+                case DIV: fused = DIV_CONST; break;
+            }
+            if (fused != RETURN) {
+                out.insert(out.end(), {fused, bytecode[i + 1]});
+                i += 3;
+                continue;
+            }
+        }
+        if (op == PRINT && next == RETURN && i + 1 < bytecode.size()) {
+            out.push_back(PRINT_RETURN);
+            i += 2;
+            continue;
+        }
+
+        out.insert(out.end(), bytecode.begin() + i, bytecode.begin() + i + op_length(op));
+        i += op_length(op);
+    }
+    bytecode.resize(finished);
+    bytecode.insert(bytecode.end(), out.begin(), out.end());
+}
+
+// Starts a new line table entry at the next instruction, unless it's already on this line.
+void Compiler::mark_line(int line) {
+    uint32_t offset = static_cast<uint32_t>(bytecode.size());
+    if (!lines.empty() && lines.back().line == static_cast<uint32_t>(line)) return;
+    // Nothing was emitted for the previous entry, so it's replaced
+    if (!lines.empty() && lines.back().offset == offset) lines.pop_back();
+    if (lines.empty() || lines.back().line != static_cast<uint32_t>(line)) lines.push_back({offset, static_cast<uint32_t>(line)});
+}
+
 void Compiler::handler(Expr *_ast)
 {
     if (auto expr = dynamic_cast<Literal*>(_ast)) {
@@ -34,16 +365,14 @@ void Compiler::handler(Expr *_ast)
 
 void Compiler::literal_handler(Literal *expr)
 {
+    mark_line(expr->line);
     if (std::holds_alternative<std::string>(expr->value)) {
-        for (size_t i = 0; i < variable_pool.size(); i++)
-        {
-            if (variable_pool[i] == std::get<std::string>(expr->value)) {
-                bytecode.push_back(VAR);
-                bytecode.push_back(static_cast<uint8_t>(i));
-                return;
-            }
+        auto it = variable_index.find(lib::intern(std::get<std::string>(expr->value)));
+        if (it != variable_index.end()) {
+            bytecode.push_back(VAR);
+            bytecode.push_back(static_cast<uint8_t>(it->second));
+            return;
         }
-        
     }
     constant_index = add_constant(expr->value);
 
@@ -73,6 +402,7 @@ void Compiler::binary_handler(Binary *expr)
     }
 
     // Operator
+    mark_line(expr->line);
     char op = expr->op[0];
     switch (op)
     {
@@ -90,10 +420,8 @@ void Compiler::binary_handler(Binary *expr)
             else bytecode.push_back(LSS); 
             break;
         }
-        case '!': {
-            if (expr->op.size() > 1 && expr->op[1] == '=') bytecode.push_back(BEQ);
-            break;
-        }
+        case '=': bytecode.push_back(EQEQ); break;
+        case '!': bytecode.push_back(BEQ); break;
         default: throw std::runtime_error("Operator mismatch"); break;
     }
 }
@@ -105,6 +433,7 @@ void Compiler::function_handler(Function *expr)
 {
     if (expr->type == Token::Type::PRINT) {
         handler(expr->expr.get());
+        mark_line(expr->line);
         bytecode.push_back(PRINT);
     }
 }
@@ -121,12 +450,12 @@ void Compiler::variable_handler(Variable *expr)
     }   
 
     // Left side
-    size_t var_index = add_variable(expr->left.lexeme);
+    size_t var_index = add_variable(lib::intern(expr->left.lexeme));
 
     // Declaration
+    mark_line(expr->line);
     if (expr->op == "=") {
-        variable_map[var_index] = constant_index;
-        bytecode.push_back(VAR);
+        bytecode.push_back(DEF);
         bytecode.push_back(static_cast<uint8_t>(var_index));
     }
 }
@@ -137,44 +466,119 @@ size_t Compiler::add_constant(const std::variant<std::monostate, double, std::st
         if constexpr (std::is_same_v<T, std::monostate>) {
             throw std::runtime_error("Tried to add empty literal to constant pool");
         } else {
+            // Strings go in as their interned handle, so the lookup below compares pointers
+            using V = std::conditional_t<std::is_same_v<T, std::string>, lib::String, T>;
+            V value = [&]() -> V {
+                if constexpr (std::is_same_v<T, std::string>) return lib::intern(c);
+                else return c;
+            }();
+
             // Check if constant exists in constant pool
             for (size_t i = 0; i < constant_pool.size(); i++)
             {
                 // Handle different variant typing. I hate this.
-                if (std::holds_alternative<T>(constant_pool[i]) &&
-                std::get<T>(constant_pool[i]) == c) return i;
+                if (std::holds_alternative<V>(constant_pool[i]) &&
+                std::get<V>(constant_pool[i]) == value) return i;
             }
             // Not found, add it to constant_pool
-            constant_pool.push_back(c);
+            constant_pool.push_back(value);
             return constant_pool.size() - 1;
         }
     }, constant);
 }
 
-size_t Compiler::add_variable(std::string &c)
+size_t Compiler::add_variable(const lib::String& c)
 {
-    for (size_t i = 0; i < variable_pool.size(); i++)
-    {
-        if (variable_pool[i] == c) return i;
-    }
-    
-    variable_pool.push_back(c);
-    return variable_pool.size() - 1;
+    auto [it, inserted] = variable_index.try_emplace(c, variable_pool.size());
+    if (inserted) variable_pool.push_back(c);
+    return it->second;
+}
+
+// Tells the purity check that a variable already holds a number before the code runs, as a batch
+// input does. Must match what the VM is given, or the optimizations could drop a throw.
+void Compiler::bind_number(size_t var_index) {
+    verifier->bind_number(var_index);
 }
 
-std::vector<std::variant<double, std::string, bool>> Compiler::get_constant_pool()
+// Same, for a variable that starts out holding value, such as a snapshot's global.
+void Compiler::bind_value(size_t var_index, const lib::Value& value) {
+    verifier->bind_value(var_index, value);
+}
+
+std::pmr::vector<lib::Value> Compiler::get_constant_pool()
 {
     return constant_pool;
 }
 
-std::vector<std::string> Compiler::get_variable_pool()
+std::pmr::vector<lib::String> Compiler::get_variable_pool()
 {
     return variable_pool;
 }
 
-std::unordered_map<size_t, size_t> Compiler::get_variable_map()
+size_t Compiler::get_max_stack()
+{
+    return max_stack;
+}
+
+std::pmr::vector<LineRun> Compiler::get_lines()
 {
-    return variable_map;
+    return lines;
+}
+
+// Walks the final bytecode tracking how deep the stack gets, so the VM can allocate it once up front.
+void Compiler::compute_max_stack() {
+    int depth = 0;
+    for (size_t i = finished; i < bytecode.size(); i += op_length(bytecode[i])) {
+        if (bytecode[i] == RETURN || bytecode[i] == PRINT_RETURN) {
+            depth = 0;
+            continue;
+        }
+        depth += stack_effect(bytecode[i]);
+        if (depth > static_cast<int>(max_stack)) max_stack = depth;
+    }
+}
+
+int stack_effect(uint8_t op) {
+    switch (op) {
+        case CON: case VAR:
+        case VAR_GRT_CONST: case VAR_LSS_CONST: case VAR_GRTE_CONST: case VAR_LSSE_CONST:
+            return 1;
+        case ADD: case SUB: case DIV: case MUL:
+        case GRT: case LSS: case GRTE: case LSSE: case EQEQ: case BEQ:
+        case ADD_NUM: case SUB_NUM: case DIV_NUM: case MUL_NUM:
+        case GRT_NUM: case LSS_NUM: case GRTE_NUM: case LSSE_NUM:
+        case PRINT: case DEF:
+            return -1;
+        default:
+            return 0;
+    }
+}
+
+size_t operand_count(uint8_t op) {
+    switch (op) {
+        case ADD: case SUB: case MUL: case DIV:
+        case GRT: case GRTE: case LSS: case LSSE: case EQEQ: case BEQ:
+        case ADD_NUM: case SUB_NUM: case MUL_NUM: case DIV_NUM:
+        case GRT_NUM: case GRTE_NUM: case LSS_NUM: case LSSE_NUM:
+            return 2;
+        case ADD_CONST: case SUB_CONST: case MUL_CONST: case DIV_CONST:
+        case PRINT: case PRINT_RETURN: case DEF:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+size_t op_length(uint8_t op) {
+    switch (op) {
+        case CON: case VAR: case DEF:
+        case ADD_CONST: case SUB_CONST: case MUL_CONST: case DIV_CONST:
+            return 2;
+        case VAR_GRT_CONST: case VAR_LSS_CONST: case VAR_GRTE_CONST: case VAR_LSSE_CONST:
+            return 3;
+        default:
+            return 1;
+    }
 }
 
 void Compiler::print_bytecode() {
@@ -184,4 +588,27 @@ void Compiler::print_bytecode() {
                   << static_cast<int>(b) << " ";
     }
     std::cout << std::dec << std::endl; // reset to decimal
-}
\ No newline at end of file
+}
+Program compile_program(std::string_view source, std::pmr::memory_resource* resource) {
+    Compiler compiler(resource);
+    return compile_program(source, compiler, resource);
+}
+
+Program compile_program(std::string_view source, Compiler& compiler, std::pmr::memory_resource* resource) {
+    std::pmr::unsynchronized_pool_resource front_end;
+    Lexer lexer(&front_end);
+    lexer.start(source);
+    Parser parser(lexer, &front_end);
+    while (ExprPtr stmt = parser.next_statement()) {
+        compiler.compile_statement(stmt.get());
+    }
+    if (lexer.error_check()) throw std::runtime_error("Lexical error.");
+
+    Program program(resource);
+    program.bytecode = compiler.finish();
+    program.constant_pool = compiler.get_constant_pool();
+    program.variable_pool = compiler.get_variable_pool();
+    program.max_stack = compiler.get_max_stack();
+    program.lines = compiler.get_lines();
+    return program;
+}
@@ -6,30 +6,102 @@ enum OP_CODE : lib::Byte {
     CON, ADD, SUB, DIV, MUL,
     GRT, LSS, GRTE, LSSE, EQEQ, BEQ,
     BNG, NEG,
-    PRINT, VAR,
-    RETURN
+    PRINT, VAR, DEF,
+    RETURN,
+    // Quickened forms, only ever written by the VM over their generic counterpart
+    ADD_NUM, SUB_NUM, DIV_NUM, MUL_NUM,
+    GRT_NUM, LSS_NUM, GRTE_NUM, LSSE_NUM,
+    // Superinstructions, emitted by Compiler::peephole for sequences the compiler produces constantly
+    ADD_CONST, SUB_CONST, DIV_CONST, MUL_CONST,
+    VAR_GRT_CONST, VAR_LSS_CONST, VAR_GRTE_CONST, VAR_LSSE_CONST,
+    PRINT_RETURN
 };
 
+// Size in bytes of an instruction, opcode included.
+size_t op_length(uint8_t op);
+// Net number of values an instruction pushes onto the stack (negative when it pops).
+// RETURN and PRINT_RETURN end a statement and empty the stack instead.
+int stack_effect(uint8_t op);
+// Number of values an instruction takes off the stack before pushing anything.
+size_t operand_count(uint8_t op);
+
+// One entry of a Program's line table: the instructions from offset up to the next entry's offset
+// all came from this source line.
+struct LineRun {
+    uint32_t offset;
+    uint32_t line;
+};
+
+// A compiled script. Owns its bytecode so the VM can rewrite instructions in place while running it.
+struct Program {
+    std::pmr::vector<uint8_t> bytecode;
+    std::pmr::vector<lib::Value> constant_pool;
+    std::pmr::vector<lib::String> variable_pool;
+    std::pmr::vector<LineRun> lines;
+    size_t max_stack = 0;
+
+    explicit Program(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : bytecode(resource), constant_pool(resource), variable_pool(resource), lines(resource) {}
+
+    uint32_t line_at(size_t offset) const;
+};
+
+class Verifier;
+
 class Compiler {
     private:
-        std::vector<uint8_t> bytecode;
-        const std::vector<std::unique_ptr<Expr>>& ast;
-        std::vector<std::variant<double, std::string, bool>> constant_pool;
-        std::vector<std::string> variable_pool;
-        std::unordered_map<size_t, size_t> variable_map;
+        std::pmr::vector<uint8_t> bytecode;
+        const std::pmr::vector<ExprPtr>* ast = nullptr;
+        std::pmr::vector<lib::Value> constant_pool;
+        std::pmr::vector<lib::String> variable_pool;
+        std::pmr::unordered_map<lib::String, size_t> variable_index;
+        std::pmr::vector<LineRun> lines;
         size_t constant_index;
+        size_t max_stack = 0;
+        size_t finished = 0;
+        size_t temporaries = 0;
+        bool optimize = true;
+        // Pool sizes as of the last finish(), or the first statement since, restored by discard()
+        size_t kept_constants = 0;
+        size_t kept_variables = 0;
+        // Over this compiler's own bytecode and pools, carried from one finish() to the next
+        std::unique_ptr<Verifier> verifier;
+
+        // Replaces bytecode[start, end) with replacement; start == end inserts
+        struct Edit {
+            size_t start;
+            size_t end;
+            std::vector<uint8_t> replacement;
+        };
+        void apply(std::vector<Edit>& edits);
+        std::pmr::vector<LineRun>::iterator tail_runs();
+        bool provably_pure();
 
     public:
-        Compiler(const std::vector<std::unique_ptr<Expr>>& ast);
+        Compiler(const std::pmr::vector<ExprPtr>& ast, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+        Compiler(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
         ~Compiler();
 
-        std::vector<uint8_t> compile();
+        std::pmr::vector<uint8_t> compile();
+        void compile_statement(Expr* stmt);
+        const std::pmr::vector<uint8_t>& finish();
+        void discard();
+        void set_optimize(bool enabled);
+        void link(Program& program);
+        void eliminate_dead_stores();
+        void eliminate_common_subexpressions();
+        void peephole();
+        void compute_max_stack();
+        void mark_line(int line);
         size_t add_constant(const std::variant<std::monostate, double, std::string, bool>&  c);
-        size_t add_variable(std::string& c);
-        std::vector<std::variant<double, std::string, bool>> get_constant_pool();
-        std::vector<std::string> get_variable_pool();
-        std::unordered_map<size_t, size_t> get_variable_map();
-        
+        size_t add_variable(const lib::String& c);
+        void bind_number(size_t var_index);
+        void bind_value(size_t var_index, const lib::Value& value);
+        std::pmr::vector<lib::Value> get_constant_pool();
+        std::pmr::vector<lib::String> get_variable_pool();
+        size_t get_max_stack();
+        std::pmr::vector<LineRun> get_lines();
+
         void handler(Expr *_ast);
         void literal_handler(Literal *expr);
         void binary_handler(Binary *expr);
@@ -38,4 +110,11 @@ class Compiler {
         void variable_handler(Variable *expr);
 
         void print_bytecode();
-};
\ No newline at end of file
+};
+
+// Lexes, parses and compiles source a statement at a time into a finished Program allocated from
+// resource. Each statement's AST is freed before the next is parsed. Throws if the lexer reported
+// errors.
+Program compile_program(std::string_view source, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+// The same, compiling with compiler, for callers that declare variables or constants beforehand
+Program compile_program(std::string_view source, Compiler& compiler, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
@@ -0,0 +1,21 @@
+#include "diagnostics.h"
+
+Diagnostics::Diagnostics(size_t capacity) : capacity(capacity) {
+    entries.reserve(capacity);
+}
+
+Diagnostics::~Diagnostics() {}
+
+void Diagnostics::clear() {
+    entries.clear();
+    dropped = 0;
+}
+
+// Every error reported since the last clear(), including those there was no room to keep.
+size_t Diagnostics::count() {
+    return entries.size() + dropped;
+}
+
+const std::vector<Diagnostic>& Diagnostics::get_entries() {
+    return entries;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "libraries.h"
+
+// One error found while checking a script. The message is formatted into a fixed buffer, so
+// reporting never allocates; anything longer than the buffer is cut off.
+struct Diagnostic {
+    static constexpr size_t MESSAGE_SIZE = 120;
+
+    int line;
+    size_t length;
+    char message[MESSAGE_SIZE];
+
+    std::string_view text() const { return {message, length}; }
+};
+
+// Collects the errors the lexer and parser run into instead of printing or throwing them. Storage
+// is reserved up front and kept across clear(), so one list serves every file a process checks;
+// once it's full, further errors are only counted.
+class Diagnostics {
+    public:
+        static constexpr size_t DEFAULT_CAPACITY = 1024;
+
+    private:
+        std::vector<Diagnostic> entries;
+        size_t capacity;
+        size_t dropped = 0;
+
+    public:
+        Diagnostics(size_t capacity = DEFAULT_CAPACITY);
+        ~Diagnostics();
+
+        template <typename... Args>
+        void report(int line, std::format_string<Args...> format, Args&&... args) {
+            if (entries.size() == capacity) {
+                dropped++;
+                return;
+            }
+            Diagnostic& diagnostic = entries.emplace_back();
+            diagnostic.line = line;
+            auto result = std::format_to_n(diagnostic.message, Diagnostic::MESSAGE_SIZE, format, std::forward<Args>(args)...);
+            diagnostic.length = std::min<size_t>(result.size, Diagnostic::MESSAGE_SIZE);
+        }
+
+        void clear();
+        size_t count();
+        const std::vector<Diagnostic>& get_entries();
+};
@@ -0,0 +1,128 @@
+#include "gc.h"
+#include <algorithm>
+
+// Below this length concatenation just copies; a rope only pays off once the pieces get long.
+static constexpr size_t ROPE_THRESHOLD = 64;
+
+Heap::Heap(size_t threshold, double growth_factor)
+    : next_gc(threshold), min_threshold(threshold), growth_factor(growth_factor) {}
+
+Heap::~Heap() {
+    while (objects) {
+        lib::Object* next = objects->next;
+        delete static_cast<lib::StringObject*>(objects);
+        objects = next;
+    }
+}
+
+lib::StringObject* Heap::allocate() {
+    auto* object = new lib::StringObject();
+    object->next = objects;
+    objects = object;
+    bytes_allocated += sizeof(lib::StringObject);
+    return object;
+}
+
+// Returns left + right. Appends in place when left is the newest handle to a flat buffer this heap
+// owns, and otherwise builds a rope node once the result is long enough for copying to matter.
+lib::String Heap::concat(lib::String left, lib::String right) {
+    size_t length = left.length() + right.length();
+    lib::StringObject* l = left.get();
+
+    if (!l->interned && !l->is_rope() && left.length() == l->chars.size()) {
+        size_t capacity = l->chars.capacity();
+        if (right.get() == l) l->chars.append(std::string(right.str()));
+        else l->chars.append(right.str());
+        bytes_allocated += l->chars.capacity() - capacity;
+        return lib::String(l, length);
+    }
+
+    lib::StringObject* object = allocate();
+    if (length < ROPE_THRESHOLD) {
+        object->chars.reserve(length);
+        object->chars.append(left.str());
+        object->chars.append(right.str());
+        bytes_allocated += object->chars.capacity();
+    } else {
+        object->left = left;
+        object->right = right;
+    }
+    return lib::String(object, length);
+}
+
+bool Heap::should_collect() {
+    return bytes_allocated > next_gc;
+}
+
+// Marks a root.
+void Heap::mark(const lib::Value& value) {
+    if (const lib::String* s = std::get_if<lib::String>(&value)) mark(*s);
+}
+
+// Interned strings live outside the heap and are skipped.
+void Heap::mark(const lib::String& s) {
+    if (s.interned() || s.get()->marked) return;
+    s.get()->marked = true;
+    gray.push_back(s.get());
+}
+
+void Heap::collect() {
+    auto start = std::chrono::steady_clock::now();
+
+    trace();
+    sweep();
+    next_gc = std::max(min_threshold, static_cast<size_t>(bytes_allocated * growth_factor));
+
+    auto pause = std::chrono::steady_clock::now() - start;
+    stats.collections++;
+    stats.total_pause += pause;
+    stats.max_pause = std::max(stats.max_pause, std::chrono::duration_cast<std::chrono::nanoseconds>(pause));
+}
+
+// Drains the gray worklist instead of recursing, so deep ropes can't overflow the native stack.
+void Heap::trace() {
+    while (!gray.empty()) {
+        lib::StringObject* object = gray.back();
+        gray.pop_back();
+        if (!object->is_rope()) continue;
+        mark(object->left);
+        mark(object->right);
+    }
+}
+
+// Frees everything left unmarked. Live bytes are recounted from the survivors, which also picks up
+// buffers that grew when a rope was flattened outside the heap's view.
+void Heap::sweep() {
+    bytes_allocated = 0;
+    lib::Object** link = &objects;
+    while (*link) {
+        auto* s = static_cast<lib::StringObject*>(*link);
+        size_t size = sizeof(lib::StringObject) + s->chars.capacity();
+        if (s->marked) {
+            s->marked = false;
+            bytes_allocated += size;
+            link = &s->next;
+            continue;
+        }
+        *link = s->next;
+        stats.objects_freed++;
+        stats.bytes_freed += size;
+        delete s;
+    }
+}
+
+size_t Heap::get_bytes_allocated() {
+    return bytes_allocated;
+}
+
+const GCStats& Heap::get_stats() {
+    return stats;
+}
+
+void Heap::print_stats() {
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    std::cout << std::format("GC: {} collections, {} objects / {} bytes freed, {} bytes live, pause total {}us max {}us",
+        stats.collections, stats.objects_freed, stats.bytes_freed, bytes_allocated,
+        duration_cast<microseconds>(stats.total_pause).count(), duration_cast<microseconds>(stats.max_pause).count()) << std::endl;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "libraries.h"
+#include <chrono>
+
+struct GCStats {
+    size_t collections = 0;
+    size_t objects_freed = 0;
+    size_t bytes_freed = 0;
+    std::chrono::nanoseconds total_pause{0};
+    std::chrono::nanoseconds max_pause{0};
+};
+
+// Owns every object a VM allocates while running and reclaims the unreachable ones with a
+// non-recursive mark-sweep pass. The VM decides when it is safe to collect and marks its roots;
+// the heap only says when it has grown past its threshold.
+class Heap {
+    private:
+        lib::Object* objects = nullptr;
+        std::vector<lib::StringObject*> gray;
+
+        size_t bytes_allocated = 0;
+        size_t next_gc;
+        size_t min_threshold;
+        double growth_factor;
+        GCStats stats;
+
+        lib::StringObject* allocate();
+        void trace();
+        void sweep();
+
+    public:
+        static constexpr size_t DEFAULT_THRESHOLD = 1024 * 1024;
+        static constexpr double DEFAULT_GROWTH_FACTOR = 2.0;
+
+        Heap(size_t threshold = DEFAULT_THRESHOLD, double growth_factor = DEFAULT_GROWTH_FACTOR);
+        ~Heap();
+
+        lib::String concat(lib::String left, lib::String right);
+
+        bool should_collect();
+        void mark(const lib::Value& value);
+        void mark(const lib::String& s);
+        void collect();
+
+        size_t get_bytes_allocated();
+        const GCStats& get_stats();
+        void print_stats();
+};
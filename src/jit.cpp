@@ -0,0 +1,262 @@
+#include "jit.h"
+#include <bit>
+#include <cstring>
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#define JIT_X86_64 1
+#endif
+
+// Template JIT for numeric programs. Each instruction expands to a fixed run of SSE2 instructions
+// operating on the register its stack slot maps to, so the value stack never touches memory. Only
+// programs the Verifier accepts and that never use strings are translated, which leaves doubles and
+// booleans; booleans are kept as 1.0 or 0.0 and tracked statically so prints still format them as
+// the VM does. Everything else, and every non-x86-64 host, runs on the VM instead.
+//
+// Generated code follows the System V ABI: the entry takes the globals array in rdi and keeps it in
+// rbx, and the frame reserves a spill area for the stack registers that have to survive a call.
+
+// SSE opcodes, all in the 0F map
+static constexpr uint8_t MOVSD_LOAD = 0x10, MOVSD_STORE = 0x11, MOVAPD = 0x28, ANDPD = 0x54;
+static constexpr uint8_t ADDSD = 0x58, MULSD = 0x59, SUBSD = 0x5C, DIVSD = 0x5E, CMPSD = 0xC2;
+static constexpr uint8_t CMP_LT = 1, CMP_LE = 2;
+static constexpr int SCRATCH = 15;
+static constexpr uint8_t SPILL_BYTES = 128;
+
+static void print_number(double value) {
+    std::cout << std::to_string(value);
+}
+
+static void print_bool(double value) {
+    std::cout << std::to_string(value != 0);
+}
+
+static void print_newline() {
+    std::cout << "\n";
+}
+
+Jit::Jit(const Program& program) : program(program) {}
+
+Jit::~Jit() {
+#ifdef JIT_X86_64
+    if (buffer) munmap(buffer, buffer_size);
+#endif
+}
+
+// Translates the whole program. Returns false, with the reason in get_error(), if any part of it
+// has to run on the VM.
+bool Jit::compile() {
+#ifndef JIT_X86_64
+    return fail(0, "JIT only targets x86-64");
+#else
+    Verifier verifier(program);
+    if (!verifier.verify()) return fail(0, "Program doesn't verify");
+    for (const lib::Value& constant : program.constant_pool) {
+        if (std::holds_alternative<lib::String>(constant)) return fail(0, "Strings aren't supported by the JIT");
+    }
+
+    code.clear();
+    stack.clear();
+    global_types.assign(program.variable_pool.size(), std::nullopt);
+
+    // push rbx; sub rsp, SPILL_BYTES; mov rbx, rdi
+    emit_bytes({0x53, 0x48, 0x81, 0xEC, SPILL_BYTES, 0, 0, 0, 0x48, 0x89, 0xFB});
+    const std::pmr::vector<uint8_t>& bytecode = program.bytecode;
+    for (size_t i = 0; i < bytecode.size(); i += op_length(bytecode[i])) {
+        if (!emit(i)) return false;
+    }
+    // add rsp, SPILL_BYTES; pop rbx; ret
+    emit_bytes({0x48, 0x81, 0xC4, SPILL_BYTES, 0, 0, 0, 0x5B, 0xC3});
+
+    return install();
+#endif
+}
+
+bool Jit::emit(size_t offset) {
+    const std::pmr::vector<uint8_t>& bytecode = program.bytecode;
+    uint8_t op = bytecode[offset];
+    int top = static_cast<int>(stack.size()) - 1;
+
+    auto constant = [&](uint8_t index) {
+        const lib::Value& value = program.constant_pool[index];
+        if (auto v = std::get_if<bool>(&value)) return std::pair{*v ? 1.0 : 0.0, Type::BOOL};
+        return std::pair{std::get<double>(value), Type::NUMBER};
+    };
+
+    switch (op)
+    {
+        case CON: case VAR:
+        case VAR_GRT_CONST: case VAR_GRTE_CONST: case VAR_LSS_CONST: case VAR_LSSE_CONST: {
+            // VAR_*_CONST borrows the register above its result for the constant
+            size_t needed = op == CON || op == VAR ? 1 : 2;
+            if (stack.size() + needed > MAX_REGISTERS) return fail(offset, "Stack deeper than the JIT has registers");
+            break;
+        }
+        default: break;
+    }
+
+    switch (op)
+    {
+        case CON: {
+            auto [value, type] = constant(bytecode[offset + 1]);
+            emit_load_constant(top + 1, value);
+            stack.push_back(type);
+            break;
+        }
+        case VAR: {
+            uint8_t var_index = bytecode[offset + 1];
+            emit_global(MOVSD_LOAD, top + 1, var_index);
+            stack.push_back(*global_types[var_index]);
+            break;
+        }
+        case DEF: {
+            uint8_t var_index = bytecode[offset + 1];
+            emit_global(MOVSD_STORE, top, var_index);
+            global_types[var_index] = stack.back();
+            stack.pop_back();
+            break;
+        }
+        case ADD: case ADD_NUM: emit_sse(0xF2, ADDSD, top - 1, top); stack.pop_back(); break;
+        case SUB: case SUB_NUM: emit_sse(0xF2, SUBSD, top - 1, top); stack.pop_back(); break;
+        case MUL: case MUL_NUM: emit_sse(0xF2, MULSD, top - 1, top); stack.pop_back(); break;
+        case DIV: case DIV_NUM: emit_sse(0xF2, DIVSD, top - 1, top); stack.pop_back(); break;
+        case GRT: case GRT_NUM: case GRTE: case GRTE_NUM:
+        case LSS: case LSS_NUM: case LSSE: case LSSE_NUM: {
+            bool greater = op == GRT || op == GRT_NUM || op == GRTE || op == GRTE_NUM;
+            bool equal = op == GRTE || op == GRTE_NUM || op == LSSE || op == LSSE_NUM;
+            emit_compare(top - 1, top - 1, top, equal ? CMP_LE : CMP_LT, greater);
+            stack.pop_back();
+            stack.back() = Type::BOOL;
+            break;
+        }
+        case ADD_CONST: case SUB_CONST: case MUL_CONST: case DIV_CONST: {
+            uint8_t opcode = op == ADD_CONST ? ADDSD : op == SUB_CONST ? SUBSD : op == MUL_CONST ? MULSD : DIVSD;
+            emit_load_constant(SCRATCH, constant(bytecode[offset + 1]).first);
+            emit_sse(0xF2, opcode, top, SCRATCH);
+            break;
+        }
+        case VAR_GRT_CONST: case VAR_GRTE_CONST: case VAR_LSS_CONST: case VAR_LSSE_CONST: {
+            bool greater = op == VAR_GRT_CONST || op == VAR_GRTE_CONST;
+            bool equal = op == VAR_GRTE_CONST || op == VAR_LSSE_CONST;
+            emit_global(MOVSD_LOAD, top + 1, bytecode[offset + 1]);
+            emit_load_constant(top + 2, constant(bytecode[offset + 2]).first);
+            emit_compare(top + 1, top + 1, top + 2, equal ? CMP_LE : CMP_LT, greater);
+            stack.push_back(Type::BOOL);
+            break;
+        }
+        case PRINT: {
+            emit_print(stack.back());
+            stack.pop_back();
+            break;
+        }
+        case PRINT_RETURN: {
+            emit_print(stack.back());
+            emit_call(reinterpret_cast<const void*>(&print_newline));
+            stack.clear();
+            break;
+        }
+        case RETURN: {
+            emit_call(reinterpret_cast<const void*>(&print_newline));
+            stack.clear();
+            break;
+        }
+        default: return fail(offset, "Opcode not supported by the JIT");
+    }
+    return true;
+}
+
+// Copies the generated code into its own pages and makes them executable. The pages are never
+// writable and executable at the same time.
+bool Jit::install() {
+#ifdef JIT_X86_64
+    size_t page = 4096;
+    buffer_size = (code.size() + page - 1) / page * page;
+    buffer = mmap(nullptr, buffer_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED) {
+        buffer = nullptr;
+        return fail(0, "Couldn't map memory for the JIT");
+    }
+    std::memcpy(buffer, code.data(), code.size());
+    if (mprotect(buffer, buffer_size, PROT_READ | PROT_EXEC) != 0) return fail(0, "Couldn't make JIT code executable");
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Jit::execute() {
+    if (!buffer) throw std::runtime_error("JIT code executed before a successful compile.");
+    globals.assign(program.variable_pool.size(), 0.0);
+    reinterpret_cast<Entry>(buffer)(globals.data());
+}
+
+void Jit::emit_bytes(std::initializer_list<uint8_t> bytes) {
+    code.insert(code.end(), bytes);
+}
+
+// <prefix> [REX] 0F <opcode> with both operands in xmm registers.
+void Jit::emit_sse(uint8_t prefix, uint8_t opcode, int reg, int rm) {
+    code.push_back(prefix);
+    if ((reg | rm) & 8) code.push_back(0x40 | ((reg & 8) >> 1) | ((rm & 8) >> 3));
+    emit_bytes({0x0F, opcode, static_cast<uint8_t>(0xC0 | (reg & 7) << 3 | (rm & 7))});
+}
+
+// movsd between an xmm register and globals[var_index], addressed off rbx.
+void Jit::emit_global(uint8_t opcode, int reg, uint8_t var_index) {
+    code.push_back(0xF2);
+    if (reg & 8) code.push_back(0x44);
+    int32_t displacement = var_index * static_cast<int32_t>(sizeof(double));
+    emit_bytes({0x0F, opcode, static_cast<uint8_t>(0x80 | (reg & 7) << 3 | 3)});
+    for (int shift = 0; shift < 32; shift += 8) code.push_back(static_cast<uint8_t>(displacement >> shift));
+}
+
+// movsd between an xmm register and a slot of the spill area at rsp.
+void Jit::emit_spill(uint8_t opcode, int reg, size_t slot) {
+    code.push_back(0xF2);
+    if (reg & 8) code.push_back(0x44);
+    emit_bytes({0x0F, opcode, static_cast<uint8_t>(0x40 | (reg & 7) << 3 | 4), 0x24, static_cast<uint8_t>(slot * sizeof(double))});
+}
+
+// mov rax, imm64; movq xmm, rax
+void Jit::emit_load_constant(int reg, double value) {
+    uint64_t bits = std::bit_cast<uint64_t>(value);
+    emit_bytes({0x48, 0xB8});
+    for (int shift = 0; shift < 64; shift += 8) code.push_back(static_cast<uint8_t>(bits >> shift));
+    emit_bytes({0x66, static_cast<uint8_t>(0x48 | ((reg & 8) >> 1)), 0x0F, 0x6E, static_cast<uint8_t>(0xC0 | (reg & 7) << 3)});
+}
+
+// Writes 1.0 to dst if a <predicate> b holds (b <predicate> a when swapped), 0.0 otherwise. dst may
+// be one of the operands.
+void Jit::emit_compare(int dst, int a, int b, uint8_t predicate, bool swap) {
+    emit_sse(0x66, MOVAPD, SCRATCH, swap ? b : a);
+    emit_sse(0xF2, CMPSD, SCRATCH, swap ? a : b);
+    code.push_back(predicate);
+    emit_load_constant(dst, 1.0);
+    emit_sse(0x66, ANDPD, dst, SCRATCH);
+}
+
+// mov rax, imm64; call rax
+void Jit::emit_call(const void* function) {
+    uint64_t address = reinterpret_cast<uint64_t>(function);
+    emit_bytes({0x48, 0xB8});
+    for (int shift = 0; shift < 64; shift += 8) code.push_back(static_cast<uint8_t>(address >> shift));
+    emit_bytes({0xFF, 0xD0});
+}
+
+// Prints the top of the stack. Every xmm register is caller-saved, so the slots below it are
+// spilled around the call.
+void Jit::emit_print(Type type) {
+    int top = static_cast<int>(stack.size()) - 1;
+    for (int reg = 0; reg < top; reg++) emit_spill(MOVSD_STORE, reg, reg);
+    if (top != 0) emit_sse(0x66, MOVAPD, 0, top);
+    emit_call(reinterpret_cast<const void*>(type == Type::BOOL ? &print_bool : &print_number));
+    for (int reg = 0; reg < top; reg++) emit_spill(MOVSD_LOAD, reg, reg);
+}
+
+bool Jit::fail(size_t offset, const char* reason) {
+    error = std::format("[offset {}] {}", offset, reason);
+    return false;
+}
+
+const std::string& Jit::get_error() {
+    return error;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "compiler.h"
+#include "verifier.h"
+
+// Translates a numeric Program into x86-64 machine code, one fixed template per instruction. Stack
+// slots live in SSE registers, variables in an array the generated code addresses directly, and
+// printing goes through calls back into the runtime. Programs it can't translate are left to the VM.
+class Jit {
+    private:
+        enum class Type { NUMBER, BOOL };
+        using Entry = void (*)(double* globals);
+
+        // xmm15 is scratch for constants and comparison masks, xmm0..xmm14 hold the stack
+        static constexpr size_t MAX_REGISTERS = 15;
+
+        const Program& program;
+        std::vector<uint8_t> code;
+        std::vector<Type> stack;
+        std::vector<std::optional<Type>> global_types;
+        std::vector<double> globals;
+        void* buffer = nullptr;
+        size_t buffer_size = 0;
+        std::string error;
+
+        bool fail(size_t offset, const char* reason);
+        bool emit(size_t offset);
+        bool install();
+
+        void emit_bytes(std::initializer_list<uint8_t> bytes);
+        void emit_sse(uint8_t prefix, uint8_t opcode, int reg, int rm);
+        void emit_global(uint8_t opcode, int reg, uint8_t var_index);
+        void emit_spill(uint8_t opcode, int reg, size_t slot);
+        void emit_load_constant(int reg, double value);
+        void emit_compare(int dst, int a, int b, uint8_t predicate, bool swap);
+        void emit_call(const void* function);
+        void emit_print(Type type);
+
+    public:
+        Jit(const Program& program);
+        ~Jit();
+
+        bool compile();
+        void execute();
+        const std::string& get_error();
+};
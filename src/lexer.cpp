@@ -1,152 +1,189 @@
 #include"lexer.h"
 
-Lexer::Lexer() {}
+Lexer::Lexer(std::pmr::memory_resource* resource) : tokens(resource) {}
 
 Lexer::~Lexer() {}
 
-std::vector<Token> Lexer::lexer(const std::string &source)
+std::pmr::vector<Token> Lexer::lexer(const std::string &source)
 {
-    source_size = source.size();
-    for (size_t i = 0; i < source_size; ++i) {
-        char c = source[i];
-        bool is_last = (i == source_size - 1);
-
-        switch (scan_state) {
-            case ScanState::COMMENT: {
-                if (c != '\n') continue;
+    start(source);
+    std::pmr::vector<Token> all(tokens.get_allocator());
+    while (std::optional<Token> token = next()) all.push_back(std::move(*token));
+    return all;
+}
+
+void Lexer::start(std::string_view content)
+{
+    source = content;
+    source_size = content.size();
+    index = 0;
+    finished = false;
+}
+
+// Pull-based scanning. The newest token may still grow or merge with the next character
+// (e.g. '=' after '='), so a token is only handed out once another one has started after it.
+// At most two tokens are ever buffered, whatever the size of the source.
+std::optional<Token> Lexer::next()
+{
+    while (tokens.size() < 2 && !finished) {
+        if (index < static_cast<size_t>(source_size)) {
+            scan(index++);
+        } else {
+            tokens.push_back(Token{Token::Type::EOF_TOKEN, "", line});
+            finished = true;
+        }
+    }
+    if (tokens.empty()) return std::nullopt;
+
+    Token token = std::move(tokens.front());
+    tokens.erase(tokens.begin());
+    return token;
+}
+
+void Lexer::scan(size_t i)
+{
+    char c = source[i];
+    bool is_last = (i == source_size - 1);
+
+    switch (scan_state) {
+        case ScanState::COMMENT: {
+            if (c != '\n') return;
+            scan_state = ScanState::NORMAL;
+            break;
+        }
+        case ScanState::STRING: {
+            if (c != '\"') {
+                if(is_last) {
+                    if (diagnostics) diagnostics->report(line, "Error: Unterminated string.");
+                    else std::cerr << std::format("[line {}] Error: Unterminated string.", line) << std::endl;
+                    tokens.pop_back();
+                    err = true;
+                    return;
+                }
+                if (tokens.empty() || prev_token(tokens)->type != Token::Type::STRING) tokens.push_back(Token{Token::Type::STRING, "", std::string(1, c), line});
+                else std::get<std::string>(prev_token(tokens)->literal).push_back(c);
+            } else {
+                prev_token(tokens)->lexeme = '\"' + std::get<std::string>(prev_token(tokens)->literal) + '\"';
                 scan_state = ScanState::NORMAL;
-                break;
             }
-            case ScanState::STRING: {
-                if (c != '\"') {
-                    if(is_last) {
-                        std::cerr << std::format("[line {}] Error: Unterminated string.", line) << std::endl;
-                        tokens.pop_back();
-                        err = true;
-                        continue;
-                    }
-                    if (tokens.empty() || prev_token(tokens)->type != Token::Type::STRING) tokens.push_back(Token{Token::Type::STRING, "", std::string(1, c), line});
-                    else std::get<std::string>(prev_token(tokens)->literal).push_back(c);
-                } else {
-                    prev_token(tokens)->lexeme = '\"' + std::get<std::string>(prev_token(tokens)->literal) + '\"';
-                    scan_state = ScanState::NORMAL;
-                }
-                continue;
+            return;
+        }
+        case ScanState::NUMBER: {
+            Token* ptoken = prev_token(tokens);
+            std::string& literal = std::get<std::string>(ptoken->literal);
+            size_t dot = literal.find('.');
+            if (std::isdigit(c) || (c == '.' && dot == std::string::npos)) {  
+                ptoken->lexeme.push_back(c);
+                literal.push_back(c);
+                if (!is_last) return;
             }
-            case ScanState::NUMBER: {
-                Token* ptoken = prev_token(tokens);
-                std::string& literal = std::get<std::string>(ptoken->literal);
-                size_t dot = literal.find('.');
-                if (std::isdigit(c) || (c == '.' && dot == std::string::npos)) {  
-                    ptoken->lexeme.push_back(c);
-                    literal.push_back(c);
-                    if (!is_last) continue;
-                }
-                
-                if (dot != std::string::npos) {
-                    size_t end = literal.size() - 1;
-                    while (end > dot && literal[end] == '0') {
-                        --end;
-                    }
-
-                    if (end == dot) literal = literal.substr(0, end + 2);
-                    else literal = literal.substr(0, end + 1);
-                } else {
-                    literal.append(".0");
+            
+            if (dot != std::string::npos) {
+                size_t end = literal.size() - 1;
+                while (end > dot && literal[end] == '0') {
+                    --end;
                 }
 
-                scan_state = ScanState::NORMAL; 
-                if (is_last && std::isdigit(c)) continue;
-                break;
+                if (end == dot) literal = literal.substr(0, end + 2);
+                else literal = literal.substr(0, end + 1);
+            } else {
+                literal.append(".0");
             }
-            case ScanState::IDENTIFIER: {
-                Token* ptoken = prev_token(tokens);
-                if (c != ' ' && (std::isalpha(c) || c == '_')) {
-                    ptoken->lexeme.push_back(c);
-                    if (!is_last) continue;
-                } 
-                const std::unordered_map<std::string, Token::Type> keywords = get_keywords();
-                auto it = keywords.find(ptoken->lexeme);
-                if (it != keywords.end()) {
-                    ptoken->type = it->second;
-                }
-                scan_state = ScanState::NORMAL;
-                if (is_last && (std::isalpha(c) || c == '_')) continue;
-                break;
+
+            scan_state = ScanState::NORMAL; 
+            if (is_last && std::isdigit(c)) return;
+            break;
+        }
+        case ScanState::IDENTIFIER: {
+            Token* ptoken = prev_token(tokens);
+            if (c != ' ' && (std::isalpha(c) || c == '_')) {
+                ptoken->lexeme.push_back(c);
+                if (!is_last) return;
+            } 
+            const std::unordered_map<std::string, Token::Type> keywords = get_keywords();
+            auto it = keywords.find(ptoken->lexeme);
+            if (it != keywords.end()) {
+                ptoken->type = it->second;
             }
-            default: break;
+            scan_state = ScanState::NORMAL;
+            if (is_last && (std::isalpha(c) || c == '_')) return;
+            break;
         }
+        default: break;
+    }
 
-        switch(c) {
-            case '(': tokens.push_back(Token{Token::Type::LEFT_PAREN, "(", line}); break;
-            case ')': tokens.push_back(Token{Token::Type::RIGHT_PAREN, ")", line}); break;
-            case '{': tokens.push_back(Token{Token::Type::LEFT_BRACE, "{", line}); break;
-            case '}': tokens.push_back(Token{Token::Type::RIGHT_BRACE, "}", line}); break;
-            case '*': tokens.push_back(Token{Token::Type::STAR, "*", line}); break;
-            case '.': tokens.push_back(Token{Token::Type::DOT, ".", line}); break;
-            case ',': tokens.push_back(Token{Token::Type::COMMA, ",", line}); break;
-            case '+': tokens.push_back(Token{Token::Type::PLUS, "+", line}); break;
-            case '-': tokens.push_back(Token{Token::Type::MINUS, "-", line}); break;
-            case ';': tokens.push_back(Token{Token::Type::SEMICOLON, ";", line}); break;
-            case '=': { 
-                auto prev_tok = prev_token(tokens);
-                if (connected && prev_tok != nullptr && prev_tok->line == line) {
-                    if (prev_tok->type == Token::Type::EQUAL) { replace_token(tokens, Token{Token::Type::EQUAL_EQUAL, "==", line}); connected = false; break; }
-                    if (prev_tok->type == Token::Type::BANG) { replace_token(tokens, Token{Token::Type::BANG_EQUAL, "!=", line}); connected = false; break; }
-                    if (prev_tok->type == Token::Type::LESS) { replace_token(tokens, Token{Token::Type::LESS_EQUAL, "<=", line}); connected = false; break; }
-                    if (prev_tok->type == Token::Type::GREATER) { replace_token(tokens, Token{Token::Type::GREATER_EQUAL, ">=", line}); connected = false; break; }
-                } 
-                tokens.push_back(Token{Token::Type::EQUAL, "=", line}); connected = true; break;
+    switch(c) {
+        case '(': tokens.push_back(Token{Token::Type::LEFT_PAREN, "(", line}); break;
+        case ')': tokens.push_back(Token{Token::Type::RIGHT_PAREN, ")", line}); break;
+        case '{': tokens.push_back(Token{Token::Type::LEFT_BRACE, "{", line}); break;
+        case '}': tokens.push_back(Token{Token::Type::RIGHT_BRACE, "}", line}); break;
+        case '*': tokens.push_back(Token{Token::Type::STAR, "*", line}); break;
+        case '.': tokens.push_back(Token{Token::Type::DOT, ".", line}); break;
+        case ',': tokens.push_back(Token{Token::Type::COMMA, ",", line}); break;
+        case '+': tokens.push_back(Token{Token::Type::PLUS, "+", line}); break;
+        case '-': tokens.push_back(Token{Token::Type::MINUS, "-", line}); break;
+        case ';': tokens.push_back(Token{Token::Type::SEMICOLON, ";", line}); break;
+        case '=': { 
+            auto prev_tok = prev_token(tokens);
+            if (connected && prev_tok != nullptr && prev_tok->line == line) {
+                if (prev_tok->type == Token::Type::EQUAL) { replace_token(tokens, Token{Token::Type::EQUAL_EQUAL, "==", line}); connected = false; break; }
+                if (prev_tok->type == Token::Type::BANG) { replace_token(tokens, Token{Token::Type::BANG_EQUAL, "!=", line}); connected = false; break; }
+                if (prev_tok->type == Token::Type::LESS) { replace_token(tokens, Token{Token::Type::LESS_EQUAL, "<=", line}); connected = false; break; }
+                if (prev_tok->type == Token::Type::GREATER) { replace_token(tokens, Token{Token::Type::GREATER_EQUAL, ">=", line}); connected = false; break; }
+            } 
+            tokens.push_back(Token{Token::Type::EQUAL, "=", line}); connected = true; break;
+        }
+        case '!': tokens.push_back(Token{Token::Type::BANG, "!", line}); connected = true; break;
+        case '<': tokens.push_back(Token{Token::Type::LESS, "<", line}); connected = true; break;
+        case '>': tokens.push_back(Token{Token::Type::GREATER, ">", line}); connected = true; break;
+        case '/': {
+            auto prev_tok = prev_token(tokens);
+            if (connected && prev_tok != nullptr && prev_tok->line == line && prev_tok->type == Token::Type::SLASH) {
+                tokens.pop_back();
+                scan_state = ScanState::COMMENT; 
+                break; 
             }
-            case '!': tokens.push_back(Token{Token::Type::BANG, "!", line}); connected = true; break;
-            case '<': tokens.push_back(Token{Token::Type::LESS, "<", line}); connected = true; break;
-            case '>': tokens.push_back(Token{Token::Type::GREATER, ">", line}); connected = true; break;
-            case '/': {
-                auto prev_tok = prev_token(tokens);
-                if (connected && prev_tok != nullptr && prev_tok->line == line && prev_tok->type == Token::Type::SLASH) {
-                    tokens.pop_back();
-                    scan_state = ScanState::COMMENT; 
-                    break; 
-                }
-                tokens.push_back(Token{Token::Type::SLASH, "/", line}); connected = true; break;
+            tokens.push_back(Token{Token::Type::SLASH, "/", line}); connected = true; break;
+        }
+        case '\"': scan_state = ScanState::STRING; break;
+        case '\n': connected = false; line++; break;
+        case ' ': connected = false; break;
+        case '\t': connected = false; break;
+        default: {
+            if (std::isdigit(c)) { 
+                tokens.push_back(Token{Token::Type::NUMBER, std::string(1, c), std::string(1, c), line});
+                if (std::isdigit(next_token(source, i)) || next_token(source, i) == '.') scan_state = ScanState::NUMBER; 
+                else std::get<std::string>(prev_token(tokens)->literal).append(".0");
+            } 
+
+            else if (std::isalpha(c) || c == '_') {
+                tokens.push_back(Token{Token::Type::IDENTIFIER, std::string(1, c), line});
+                if (std::isalpha(next_token(source, i))) scan_state = ScanState::IDENTIFIER;
             }
-            case '\"': scan_state = ScanState::STRING; break;
-            case '\n': connected = false; line++; break;
-            case ' ': connected = false; break;
-            case '\t': connected = false; break;
-            default: {
-                if (std::isdigit(c)) { 
-                    tokens.push_back(Token{Token::Type::NUMBER, std::string(1, c), std::string(1, c), line});
-                    if (std::isdigit(next_token(source, i)) || next_token(source, i) == '.') scan_state = ScanState::NUMBER; 
-                    else std::get<std::string>(prev_token(tokens)->literal).append(".0");
-                } 
-
-                else if (std::isalpha(c) || c == '_') {
-                    tokens.push_back(Token{Token::Type::IDENTIFIER, std::string(1, c), line});
-                    if (std::isalpha(next_token(source, i))) scan_state = ScanState::IDENTIFIER;
-                }
 
-                else { std::cerr << std::format("[line {}] Error: Unexpected character: {}", line, c) << std::endl; err = true; }
-                break;
+            else {
+                if (diagnostics) diagnostics->report(line, "Error: Unexpected character: {}", c);
+                else std::cerr << std::format("[line {}] Error: Unexpected character: {}", line, c) << std::endl;
+                err = true;
             }
+            break;
         }
     }
-    tokens.push_back(Token{Token::Type::EOF_TOKEN, "", line});
-    return tokens;
 }
 
-char Lexer::next_token(const std::string& tokens, const int index) {
+char Lexer::next_token(std::string_view tokens, const int index) {
+    if (static_cast<size_t>(index) + 1 >= tokens.size()) return '\0';
     return tokens[index + 1];
 }
 
-void Lexer::replace_token(std::vector<Token>& tokens, const Token& token) {
+void Lexer::replace_token(std::pmr::vector<Token>& tokens, const Token& token) {
     if (!tokens.empty()) {
         tokens.pop_back();
         tokens.push_back(token);
     }
 }
 
-Token* Lexer::prev_token(std::vector<Token>& tokens) {
+Token* Lexer::prev_token(std::pmr::vector<Token>& tokens) {
     if (!tokens.empty()) {
         return &tokens.back();
     }
@@ -222,4 +259,8 @@ std::string Lexer::type_to_string(Token::Type t) {
 
 bool Lexer::error_check(){
     return err;
-}
\ No newline at end of file
+}
+
+void Lexer::set_diagnostics(Diagnostics* list) {
+    diagnostics = list;
+}
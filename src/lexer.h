@@ -1,5 +1,6 @@
 #pragma once
 #include "libraries.h"
+#include "diagnostics.h"
 
 enum class ScanState {
     NORMAL, STRING, COMMENT, NUMBER, IDENTIFIER
@@ -34,25 +35,36 @@ struct Token {
 
 class Lexer {
     private:
-        std::vector<Token> tokens;
+        std::pmr::vector<Token> tokens;
         ScanState scan_state = ScanState::NORMAL;
 
+        // Source being scanned by next(); it must outlive the lexer
+        std::string_view source;
+        size_t index = 0;
+        bool finished = false;
+
         int line = 1;
         int source_size;
 
         bool connected = true;
         bool err = false;
+        // Where errors go instead of std::cerr, when set
+        Diagnostics* diagnostics = nullptr;
 
     public:
-        Lexer();
+        Lexer(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
         ~Lexer();
 
-        std::vector<Token> lexer(const std::string& content);
+        std::pmr::vector<Token> lexer(const std::string& content);
+        void start(std::string_view content);
+        std::optional<Token> next();
+        void scan(size_t i);
         std::string type_to_string(Token::Type t);
-        Token* prev_token(std::vector<Token>& tokens);
-        void replace_token(std::vector<Token>& tokens, const Token& token);
-        char next_token(const std::string& tokens, const int index);
+        Token* prev_token(std::pmr::vector<Token>& tokens);
+        void replace_token(std::pmr::vector<Token>& tokens, const Token& token);
+        char next_token(std::string_view tokens, const int index);
         const std::unordered_map<std::string, Token::Type>& get_keywords();
+        void set_diagnostics(Diagnostics* list);
 
         bool error_check();
 };
\ No newline at end of file
@@ -2,15 +2,24 @@
 #include <string>
 #include <format>
 #include <vector>
+#include <algorithm>
+#include <array>
+#include <deque>
 #include <variant>
 #include <unordered_map>
 #include <memory>
+#include <memory_resource>
+#include <optional>
+#include <span>
 #include <iostream>
 #include <stdexcept>
 #include <sstream>
 #include <iomanip>
+#include <charconv>
+#include "object.h"
 
 namespace lib {
     using Literal = std::variant<std::monostate, std::string, double, bool>;
     using Byte = uint8_t;
+    using Value = std::variant<double, String, bool>;
 }
\ No newline at end of file
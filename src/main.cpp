@@ -6,46 +6,79 @@
 #include "parser.h"
 #include "compiler.h"
 #include "vm.h"
+#include "batch.h"
+#include "jit.h"
+#include "regvm.h"
+#include "transpiler.h"
+#include "profiler.h"
+#include "scheduler.h"
+#include "server.h"
+#include "snapshot.h"
 
 const int EXIT_LEXICAL_ERROR = 65;
 const int EXIT_PARSING_ERROR = 40;
 
 struct LexerResult {
     int status;
-    std::vector<Token> tokens;
+    std::pmr::vector<Token> tokens;
 };
 
 struct ParserResult {
     int status;
-    std::vector<std::unique_ptr<Expr>> ast;
+    std::pmr::vector<ExprPtr> ast;
 };
 
 struct CompilerResult {
     int status;
-    std::vector<uint8_t> bytecode;
-    std::vector<std::variant<double, std::string, bool>> constant_pool;
-    std::vector<std::string> variable_pool;
-    std::unordered_map<size_t, size_t> variable_map;
+    Program program;
 };
 
+// What runs a compiled script: the stack VM, the JIT, or the register VM
+enum class Backend { STACK, JIT, REGISTERS };
+
 std::string read_file_contents(const std::string& filename);
 void tokenizer(char *argv[], LexerResult& lexer_r, bool debug_mode = false);
 void parser(char *argv[], LexerResult& lexer_r, ParserResult& parser_r, bool debug_mode = false);
-void compile(char *argv[], LexerResult& lexer_r, ParserResult& parser_r, CompilerResult& compiler_r, bool debug_mode = false);
+void compile(char *argv[], LexerResult& lexer_r, ParserResult& parser_r, CompilerResult& compiler_r, bool debug_mode = false, Backend backend = Backend::STACK);
+void stream(char *argv[], CompilerResult& compiler_r, bool debug_mode = false, Backend backend = Backend::STACK);
+void run(Compiler& compiler, CompilerResult& compiler_r, bool debug_mode, Backend backend);
+void benchmark(char *argv[], CompilerResult& compiler_r, size_t runs);
+void repl(bool debug_mode = false);
+void transpile(char *argv[], CompilerResult& compiler_r);
+void profile(char *argv[], CompilerResult& compiler_r, const std::string& output);
+void schedule(int argc, char *argv[]);
+void snapshot(char *argv[], CompilerResult& compiler_r);
+void restore(char *argv[], CompilerResult& compiler_r, bool debug_mode = false);
+void batch(char *argv[], CompilerResult& compiler_r, bool debug_mode = false);
+int check(int argc, char *argv[]);
 
 int main(int argc, char *argv[]) {
     // Disable output buffering
     std::cout << std::unitbuf;
     std::cerr << std::unitbuf;
+
+    // --jit and --registers may appear anywhere; they're taken out so the positional arguments stay
+    // where they were
+    Backend backend = Backend::STACK;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--jit") backend = Backend::JIT;
+        else if (std::string(argv[i]) == "--registers") backend = Backend::REGISTERS;
+        else continue;
+        std::copy(argv + i + 1, argv + argc, argv + i);
+        argc--;
+        i--;
+    }
     
-    if (argc < 3) {
-        std::cerr << "Usage: ./your_program [tokenize | parse] <filename>" << std::endl;
+    if (argc < 3 && !(argc == 2 && (std::string(argv[1]) == "repl" || std::string(argv[1]) == "serve"))) {
+        std::cerr << "Usage: ./your_program [tokenize | parse | compile | stream] <filename> [--jit | --registers] | check <filename>... | benchmark <filename> [runs] | transpile <filename> | profile <filename> [out.folded] | schedule <filename>... | serve [socket] | snapshot <filename> <out.snap> | restore <snapshot> <filename> | batch <filename> <data.csv> | repl" << std::endl;
         return EXIT_FAILURE;
     }
 
-    LexerResult lexer_r;
-    ParserResult parser_r;
-    CompilerResult compiler_r;
+    // Every stage of the run allocates from one arena, released in one go when main returns
+    std::pmr::monotonic_buffer_resource arena;
+    LexerResult lexer_r{EXIT_SUCCESS, std::pmr::vector<Token>(&arena)};
+    ParserResult parser_r{EXIT_SUCCESS, std::pmr::vector<ExprPtr>(&arena)};
+    CompilerResult compiler_r{EXIT_SUCCESS, Program(&arena)};
     
     const std::string command = argv[1];
     
@@ -69,9 +102,78 @@ int main(int argc, char *argv[]) {
     else if (command == "compile") {
         if (argc > 3 && std::string(argv[3]) == "debug") { 
             std::cout << "[DEBUG MODE]" << std::endl;
-            compile(argv, lexer_r, parser_r, compiler_r, true);
+            compile(argv, lexer_r, parser_r, compiler_r, true, backend);
+        }
+        else compile(argv, lexer_r, parser_r, compiler_r, false, backend);
+    }
+    // STREAMING COMPILER
+    else if (command == "stream") {
+        if (argc > 3 && std::string(argv[3]) == "debug") {
+            std::cout << "[DEBUG MODE]" << std::endl;
+            stream(argv, compiler_r, true, backend);
+        }
+        else stream(argv, compiler_r, false, backend);
+    }
+    // LINTER
+    else if (command == "check") {
+        return check(argc, argv);
+    }
+    // STACK VM AGAINST REGISTER VM
+    else if (command == "benchmark") {
+        benchmark(argv, compiler_r, argc > 3 ? std::stoul(argv[3]) : 100);
+    }
+    // AHEAD-OF-TIME
+    else if (command == "transpile") {
+        transpile(argv, compiler_r);
+    }
+    // SAMPLING PROFILER
+    else if (command == "profile") {
+        profile(argv, compiler_r, argc > 3 ? argv[3] : std::string(argv[2]) + ".folded");
+    }
+    // CONCURRENT
+    else if (command == "schedule") {
+        schedule(argc, argv);
+    }
+    // SNAPSHOTS
+    else if (command == "snapshot" || command == "restore") {
+        if (argc < 4) {
+            std::cerr << "Usage: ./your_program [snapshot <filename> <out.snap> | restore <snapshot> <filename>]" << std::endl;
+            return EXIT_FAILURE;
         }
-        else compile(argv, lexer_r, parser_r, compiler_r);
+        if (command == "snapshot") snapshot(argv, compiler_r);
+        else if (argc > 4 && std::string(argv[4]) == "debug") {
+            std::cout << "[DEBUG MODE]" << std::endl;
+            restore(argv, compiler_r, true);
+        }
+        else restore(argv, compiler_r);
+    }
+    // SERVER
+    else if (command == "serve") {
+        // Replies carry exact byte counts, so stdout goes back to being buffered
+        std::cout << std::nounitbuf;
+        Server server;
+        if (argc > 2) server.serve(argv[2]);
+        else server.serve(std::cin, std::cout);
+    }
+    // VECTORIZED
+    else if (command == "batch") {
+        if (argc < 4) {
+            std::cerr << "Usage: ./your_program batch <filename> <data.csv>" << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (argc > 4 && std::string(argv[4]) == "debug") {
+            std::cout << "[DEBUG MODE]" << std::endl;
+            batch(argv, compiler_r, true);
+        }
+        else batch(argv, compiler_r);
+    }
+    // INTERACTIVE
+    else if (command == "repl") {
+        if (argc > 2 && std::string(argv[2]) == "debug") {
+            std::cout << "[DEBUG MODE]" << std::endl;
+            repl(true);
+        }
+        else repl();
     } else {
         std::cerr << "Unknown command: " << command << std::endl;
         return EXIT_FAILURE;
@@ -83,7 +185,7 @@ void tokenizer(char *argv[], LexerResult& lexer_r, bool debug_mode) {
     std::string file_contents = read_file_contents(argv[2]);
     
     if (!file_contents.empty()) {
-        Lexer lexer;
+        Lexer lexer(lexer_r.tokens.get_allocator().resource());
         lexer_r.tokens = lexer.lexer(file_contents);
 
         if (debug_mode) {
@@ -108,7 +210,7 @@ void parser(char *argv[], LexerResult& lexer_r, ParserResult& parser_r, bool deb
 
     if (!file_contents.empty()) {
         tokenizer(argv, lexer_r);
-        Parser parser(lexer_r.tokens);
+        Parser parser(lexer_r.tokens, parser_r.ast.get_allocator().resource());
         parser_r.ast = parser.parse();
         if (debug_mode) parser.print_program(parser_r.ast);
         std::cout << std::endl;
@@ -117,23 +219,357 @@ void parser(char *argv[], LexerResult& lexer_r, ParserResult& parser_r, bool deb
     parser_r.status = EXIT_SUCCESS;
 }
 
-void compile(char *argv[], LexerResult& lexer_r, ParserResult& parser_r, CompilerResult& compiler_r, bool debug_mode) {
+void compile(char *argv[], LexerResult& lexer_r, ParserResult& parser_r, CompilerResult& compiler_r, bool debug_mode, Backend backend) {
     bool err = false;
     std::string file_contents = read_file_contents(argv[2]);
 
     if (!file_contents.empty()) {
         parser(argv, lexer_r, parser_r, true);
-        Compiler compiler(parser_r.ast);
-        compiler_r.bytecode = compiler.compile();
-        compiler_r.constant_pool = compiler.get_constant_pool();
-        compiler_r.variable_pool = compiler.get_variable_pool();
-        compiler_r.variable_map = compiler.get_variable_map();
+        Compiler compiler(parser_r.ast, compiler_r.program.bytecode.get_allocator().resource());
+        compiler_r.program.bytecode = compiler.compile();
+        compiler_r.program.constant_pool = compiler.get_constant_pool();
+        compiler_r.program.variable_pool = compiler.get_variable_pool();
+        compiler_r.program.max_stack = compiler.get_max_stack();
+        compiler_r.program.lines = compiler.get_lines();
+        run(compiler, compiler_r, debug_mode, backend);
+    }
+}
+
+// Same as compile, but tokens are pulled from the lexer on demand and each statement's AST is
+// compiled and freed before the next one is parsed, so front-end memory never holds more than one
+// statement. The front end allocates from a pool so freed nodes are reused by the next statement.
+void stream(char *argv[], CompilerResult& compiler_r, bool debug_mode, Backend backend) {
+    std::string file_contents = read_file_contents(argv[2]);
+
+    if (!file_contents.empty()) {
+        std::pmr::memory_resource* resource = compiler_r.program.bytecode.get_allocator().resource();
+        Compiler compiler(resource);
+        compiler_r.program = compile_program(file_contents, compiler, resource);
+        run(compiler, compiler_r, debug_mode, backend);
+    }
+}
+
+void run(Compiler& compiler, CompilerResult& compiler_r, bool debug_mode, Backend backend) {
+    if (debug_mode) {
+        compiler.print_bytecode();
+        Verifier verifier(compiler_r.program);
+        if (!verifier.verify()) std::cout << "Verifier: " << verifier.get_error() << ", running checked" << std::endl;
+    }
+    std::cout << std::endl;
+    if (backend == Backend::REGISTERS) {
+        RegisterVM vm(compiler_r.program);
+        if (vm.compile()) {
+            if (debug_mode) vm.print_code();
+            std::cout << "RESULT:\n";
+            vm.execute();
+            if (debug_mode) std::cout << "Register VM: " << vm.get_instructions() << " instructions" << std::endl;
+            return;
+        }
+        if (debug_mode) std::cout << "Register VM: " << vm.get_error() << ", falling back to the stack VM" << std::endl;
+    }
+    if (backend == Backend::JIT) {
+        Jit jit(compiler_r.program);
+        if (jit.compile()) {
+            std::cout << "RESULT:\n";
+            jit.execute();
+            return;
+        }
+        if (debug_mode) std::cout << "JIT: " << jit.get_error() << ", falling back to the VM" << std::endl;
+    }
+    VM vm(compiler_r.program);
+    std::cout << "RESULT:\n";
+    vm.execute();
+    if (debug_mode) vm.get_heap().print_stats();
+}
+
+// Lexes and parses every file given and prints every syntax error in each, rather than stopping at
+// the first one. Nothing is thrown: errors go into one preallocated Diagnostics list, reused for
+// every file, and the parser skips ahead to the next statement after each.
+int check(int argc, char *argv[]) {
+    Diagnostics diagnostics;
+    std::pmr::unsynchronized_pool_resource front_end;
+    size_t failed = 0;
+    size_t errors = 0;
+
+    for (int i = 2; i < argc; i++) {
+        std::ifstream file(argv[i]);
+        if (!file.is_open()) {
+            std::cout << std::format("{}: Error reading file", argv[i]) << std::endl;
+            failed++;
+            errors++;
+            continue;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        std::string file_contents = buffer.str();
+
+        diagnostics.clear();
+        Lexer lexer(&front_end);
+        lexer.set_diagnostics(&diagnostics);
+        lexer.start(file_contents);
+        Parser parser(lexer, &front_end);
+        parser.set_diagnostics(&diagnostics);
+        while (ExprPtr stmt = parser.next_statement()) {}
+
+        for (const Diagnostic& diagnostic : diagnostics.get_entries()) {
+            std::cout << std::format("{}:{}: {}", argv[i], diagnostic.line, diagnostic.text()) << "\n";
+        }
+        size_t dropped = diagnostics.count() - diagnostics.get_entries().size();
+        if (dropped) std::cout << std::format("{}: {} more errors not shown", argv[i], dropped) << "\n";
+        if (diagnostics.count()) failed++;
+        errors += diagnostics.count();
+    }
+
+    std::cout << std::format("[Check] {} files, {} with errors, {} errors", argc - 2, failed, errors) << std::endl;
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Runs the script runs times on the stack VM and runs times on the register VM, with output
+// discarded, and reports instructions executed and mean time per run for each.
+void benchmark(char *argv[], CompilerResult& compiler_r, size_t runs) {
+    std::string file_contents = read_file_contents(argv[2]);
+    Program& program = compiler_r.program;
+    program = compile_program(file_contents, program.bytecode.get_allocator().resource());
+
+    RegisterVM lowered(program);
+    if (!lowered.compile()) {
+        std::cerr << "Register VM: " << lowered.get_error() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    // Setup is verification for both, plus lowering for the register VM, and is timed apart from
+    // the run itself
+    using Clock = std::chrono::steady_clock;
+    struct Totals {
+        uint64_t instructions = 0;
+        Clock::duration setup{0};
+        Clock::duration run{0};
+    };
+    auto time = [](auto&& setup, auto&& run, Totals& totals) {
+        auto started = Clock::now();
+        setup();
+        auto set_up = Clock::now();
+        totals.instructions = run();
+        totals.setup += set_up - started;
+        totals.run += Clock::now() - set_up;
+    };
+
+    std::ostringstream discarded;
+    Totals stack, registers;
+    for (size_t i = 0; i < runs; i++) {
+        discarded.str("");
+        VM vm(program);
+        vm.set_output(discarded);
+        time([&]() { vm.start(); }, [&]() { vm.resume(SIZE_MAX); return vm.get_instructions(); }, stack);
+
+        discarded.str("");
+        RegisterVM register_vm(program);
+        register_vm.set_output(discarded);
+        time([&]() { register_vm.compile(); }, [&]() { register_vm.execute(); return register_vm.get_instructions(); }, registers);
+    }
+
+    auto per_run = [&](Clock::duration total) {
+        return std::chrono::duration<double, std::micro>(total).count() / std::max<size_t>(runs, 1);
+    };
+    std::cout << std::format("[Benchmark] {} runs of {}\n", runs, argv[2]);
+    for (auto [name, totals] : {std::pair{"stack VM:   ", stack}, std::pair{"register VM:", registers}}) {
+        std::cout << std::format("  {} {} instructions, {:.2f} us setup, {:.2f} us run\n",
+            name, totals.instructions, per_run(totals.setup), per_run(totals.run));
+    }
+    std::cout << std::format("  run speedup {:.2f}x, {:.1f}% fewer instructions\n",
+        registers.run.count() ? double(stack.run.count()) / registers.run.count() : 0.0,
+        stack.instructions ? 100.0 * (1.0 - double(registers.instructions) / stack.instructions) : 0.0);
+}
+
+// Prints a C++ translation unit equivalent to the script, to be built into its own binary.
+void transpile(char *argv[], CompilerResult& compiler_r) {
+    std::string file_contents = read_file_contents(argv[2]);
+    Program& program = compiler_r.program;
+    program = compile_program(file_contents, program.bytecode.get_allocator().resource());
+
+    Transpiler transpiler(program);
+    if (!transpiler.transpile(std::cout)) {
+        std::cerr << "Transpiler: " << transpiler.get_error() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+// Runs the script with the VM publishing its instruction pointer and a SIGPROF timer sampling it,
+// then writes the samples folded per source line to output for flamegraph tools.
+void profile(char *argv[], CompilerResult& compiler_r, const std::string& output) {
+    std::string file_contents = read_file_contents(argv[2]);
+    Program& program = compiler_r.program;
+    program = compile_program(file_contents, program.bytecode.get_allocator().resource());
+
+    VM vm(program);
+    vm.set_profiled(true);
+    Profiler profiler(program, vm.get_ip());
+    std::cout << "RESULT:\n";
+    profiler.start();
+    vm.execute();
+    profiler.stop();
+
+    std::ofstream file(output);
+    if (!file.is_open()) {
+        std::cerr << "Error writing file: " << output << std::endl;
+        std::exit(1);
+    }
+    profiler.write_folded(file, argv[2]);
+    std::cerr << std::format("Profiler: {} samples written to {}", profiler.total_samples(), output) << std::endl;
+}
+
+// Runs every script given concurrently on a small thread pool, time-sliced by instruction count,
+// then prints each script's output in argument order followed by per-VM counts.
+void schedule(int argc, char *argv[]) {
+    Scheduler scheduler;
+    for (int i = 2; i < argc; i++) {
+        std::string file_contents = read_file_contents(argv[i]);
+        // The VMs allocate from the program's resource on several threads, so no shared arena here
+        Program program = compile_program(file_contents);
+        scheduler.add(argv[i], std::move(program));
+    }
+
+    scheduler.run();
+    for (const auto& task : scheduler.get_tasks()) {
+        std::cout << std::format("RESULT ({}):\n", task->name) << task->output.str();
+    }
+    scheduler.print_report();
+}
+
+// Runs a script, typically a preamble that only sets up globals, and saves the state it leaves
+// behind to a snapshot file.
+void snapshot(char *argv[], CompilerResult& compiler_r) {
+    std::string file_contents = read_file_contents(argv[2]);
+    Program& program = compiler_r.program;
+    program = compile_program(file_contents, program.bytecode.get_allocator().resource());
+
+    VM vm(program);
+    std::cout << "RESULT:\n";
+    vm.execute();
+    Snapshot::write(argv[3], program, vm.get_globals());
+}
+
+// Runs a script as if the snapshotted script had run just before it, without running it again:
+// the compiler starts out knowing the snapshot's variables and constants, at the same indices, and
+// the VM starts out with the snapshot's globals.
+void restore(char *argv[], CompilerResult& compiler_r, bool debug_mode) {
+    Snapshot snapshot(argv[2]);
+    std::string file_contents = read_file_contents(argv[3]);
+    Program& program = compiler_r.program;
+
+    Compiler compiler(program.bytecode.get_allocator().resource());
+    for (const lib::String& name : snapshot.get_variables()) compiler.add_variable(name);
+    for (size_t v = 0; v < snapshot.get_globals().size(); v++) compiler.bind_value(v, snapshot.get_globals()[v]);
+    for (const lib::Value& constant : snapshot.get_constants()) {
+        std::visit([&](auto&& c) {
+            if constexpr (std::is_same_v<std::decay_t<decltype(c)>, lib::String>) compiler.add_constant(std::string(c.str()));
+            else compiler.add_constant(c);
+        }, constant);
+    }
+
+    program = compile_program(file_contents, compiler, program.bytecode.get_allocator().resource());
+    if (debug_mode) compiler.print_bytecode();
+
+    VM vm(program);
+    vm.load_globals(snapshot.get_globals());
+    std::cout << "RESULT:\n";
+    vm.execute();
+    if (debug_mode) vm.get_heap().print_stats();
+}
+
+// Runs a numeric script once for every row of a CSV file, a block of rows at a time. Each CSV column
+// is bound to the variable named in its header, declared before the script is compiled so the
+// script can read it without defining it. Prints one CSV row per input row with one column per
+// print statement.
+void batch(char *argv[], CompilerResult& compiler_r, bool debug_mode) {
+    std::string file_contents = read_file_contents(argv[2]);
+    std::stringstream data(read_file_contents(argv[3]));
+    Program& program = compiler_r.program;
+    Compiler compiler(program.bytecode.get_allocator().resource());
+
+    std::string line, cell;
+    std::vector<size_t> inputs;
+    std::getline(data, line);
+    std::stringstream header(line);
+    while (std::getline(header, cell, ',')) inputs.push_back(compiler.add_variable(lib::intern(cell)));
+    for (size_t input : inputs) compiler.bind_number(input);
+
+    std::vector<BatchVM::Column> columns(inputs.size());
+    size_t rows = 0;
+    while (std::getline(data, line)) {
+        if (line.empty()) continue;
+        std::stringstream row(line);
+        for (BatchVM::Column& column : columns) {
+            if (!std::getline(row, cell, ',')) throw std::runtime_error(std::format("Row {} has too few columns.", rows + 1));
+            column.push_back(std::stod(cell));
+        }
+        rows++;
+    }
+
+    program = compile_program(file_contents, compiler, program.bytecode.get_allocator().resource());
+    if (debug_mode) compiler.print_bytecode();
+
+    BatchVM vm(program);
+    for (size_t c = 0; c < inputs.size(); c++) vm.bind(inputs[c], columns[c]);
+    std::vector<BatchVM::Column> results = vm.execute(rows);
+
+    // Built up front, since cout is unbuffered
+    std::string out = "RESULT:\n";
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t c = 0; c < results.size(); c++) {
+            if (c) out += ',';
+            out += std::to_string(results[c][r]);
+        }
+        out += '\n';
+    }
+    std::cout << out;
+}
+
+// Reads statements a line at a time and runs each line as it comes. One Compiler and one VM live
+// for the whole session: every line is compiled onto the end of the same program and only the new
+// code runs, against the globals and heap left by earlier lines. A line that fails to lex, parse or
+// compile is dropped without touching the program.
+// A session can run indefinitely, so its program lives in a pool that gives back what it frees
+// rather than in main's arena, which would keep every buffer the growing program ever outgrew.
+void repl(bool debug_mode) {
+    std::pmr::unsynchronized_pool_resource front_end;
+    std::pmr::unsynchronized_pool_resource session;
+    Program program(&session);
+    Compiler compiler(&session);
+    VM vm(program);
+    std::string line;
+
+    while (std::cout << "> ", std::getline(std::cin, line)) {
+        try {
+            Lexer lexer(&front_end);
+            lexer.start(line);
+            Parser parser(lexer, &front_end);
+            while (ExprPtr stmt = parser.next_statement()) {
+                compiler.compile_statement(stmt.get());
+            }
+            // The lexer reports its own errors
+            if (lexer.error_check()) {
+                compiler.discard();
+                continue;
+            }
+        } catch (const std::exception& e) {
+            compiler.discard();
+            std::cerr << e.what() << std::endl;
+            continue;
+        }
+
+        size_t start = program.bytecode.size();
+        compiler.finish();
+        compiler.link(program);
         if (debug_mode) compiler.print_bytecode();
-        std::cout << std::endl;
-        VM vm(compiler_r.bytecode, compiler_r.constant_pool, compiler_r.variable_pool, compiler_r.variable_map);
-        std::cout << "RESULT:\n";
-        vm.execute();
+        try {
+            vm.execute(start);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
     }
+    std::cout << std::endl;
+    if (debug_mode) vm.get_heap().print_stats();
 }
 
 std::string read_file_contents(const std::string& filename) {
@@ -0,0 +1,89 @@
+#include "object.h"
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+    // Keys point into the chars of the object they map to. Never destroyed, so interned strings
+    // stay valid for anything still running at exit.
+    auto& intern_table = *new std::unordered_map<std::string_view, lib::StringObject*>();
+    auto& intern_mutex = *new std::mutex();
+
+    // Replaces a rope's children with their text. Iterative, as `s = s + x` chains get arbitrarily deep.
+    void flatten(lib::StringObject& rope, size_t length) {
+        std::string chars;
+        chars.reserve(length);
+        std::vector<lib::String> pending{rope.right, rope.left};
+        while (!pending.empty()) {
+            lib::String node = pending.back();
+            pending.pop_back();
+            if (node.get()->is_rope()) {
+                pending.push_back(node.get()->right);
+                pending.push_back(node.get()->left);
+            } else {
+                chars.append(node.get()->chars, 0, node.length());
+            }
+        }
+        rope.chars = std::move(chars);
+        rope.left = rope.right = lib::String(nullptr, 0);
+    }
+}
+
+std::string_view lib::String::str() const {
+    if (object->is_rope()) flatten(*object, size);
+    return std::string_view(object->chars).substr(0, size);
+}
+
+size_t lib::String::hash() const {
+    if (object->interned) return object->hash;
+    return std::hash<std::string_view>{}(str());
+}
+
+bool lib::String::interned() const {
+    return object->interned;
+}
+
+bool lib::String::operator==(const String& other) const {
+    if (object == other.object && size == other.size) return true;
+    if (object->interned && other.object->interned) return false;
+    return size == other.size && str() == other.str();
+}
+
+lib::String lib::intern(std::string_view text) {
+    std::lock_guard<std::mutex> lock(intern_mutex);
+    auto it = intern_table.find(text);
+    if (it != intern_table.end()) return String(it->second, text.size());
+
+    StringObject* object = new StringObject();
+    object->chars = std::string(text);
+    object->hash = std::hash<std::string_view>{}(text);
+    object->interned = true;
+    intern_table.emplace(object->chars, object);
+    return String(object, text.size());
+}
+
+size_t lib::interned_count() {
+    std::lock_guard<std::mutex> lock(intern_mutex);
+    return intern_table.size();
+}
+
+size_t lib::sweep_interned(std::span<const String> roots) {
+    std::lock_guard<std::mutex> lock(intern_mutex);
+    std::unordered_set<const StringObject*> live;
+    for (const String& s : roots) live.insert(s.get());
+
+    size_t freed = 0;
+    for (auto it = intern_table.begin(); it != intern_table.end();) {
+        if (live.count(it->second)) {
+            ++it;
+            continue;
+        }
+        // The key views the object's chars, so the entry goes first
+        StringObject* object = it->second;
+        it = intern_table.erase(it);
+        delete object;
+        freed++;
+    }
+    return freed;
+}
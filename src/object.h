@@ -0,0 +1,64 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <ostream>
+#include <span>
+
+namespace lib {
+    // Header shared by every heap object, linking it into the Heap that owns it.
+    struct Object {
+        Object* next = nullptr;
+        bool marked = false;
+    };
+
+    struct StringObject;
+
+    // Handle to the first `length` characters of a StringObject. Handles are plain pointers; the
+    // Heap that allocated the object (or the intern table) keeps it alive. Since a handle only sees
+    // its own prefix, the owner of the newest handle to a buffer can append to it in place without
+    // changing what older handles read.
+    class String {
+        private:
+            StringObject* object;
+            size_t size;
+
+        public:
+            String(StringObject* object, size_t size) : object(object), size(size) {}
+
+            std::string_view str() const;
+            size_t hash() const;
+            size_t length() const { return size; }
+            bool interned() const;
+            StringObject* get() const { return object; }
+
+            bool operator==(const String& other) const;
+
+            friend std::ostream& operator<<(std::ostream& os, const String& s) { return os << s.str(); }
+    };
+
+    // Interned strings are unique per text, so two interned strings are equal exactly when they are
+    // the same object. Strings built by concatenation may instead be a rope: chars stays empty and the
+    // text is left + right until something needs the characters.
+    struct StringObject : Object {
+        std::string chars;
+        size_t hash = 0;
+        bool interned = false;
+        String left{nullptr, 0};
+        String right{nullptr, 0};
+
+        bool is_rope() const { return left.get() != nullptr; }
+    };
+
+    // Returns the canonical String for text, creating it on first use. Interned strings are never
+    // collected, since every compiled Program may refer to them, unless sweep_interned says so.
+    String intern(std::string_view text);
+    size_t interned_count();
+    // Frees every interned string but roots and returns how many went. Only safe when the caller
+    // knows every String still in use in the process, such as a server between requests.
+    size_t sweep_interned(std::span<const String> roots);
+}
+
+template <>
+struct std::hash<lib::String> {
+    size_t operator()(const lib::String& s) const noexcept { return s.hash(); }
+};
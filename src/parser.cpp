@@ -11,127 +11,210 @@
 //                                  3   4
 //
 
-Parser::Parser(const std::vector<Token>& tokens) : tokens(tokens) {}
+Parser::Parser(const std::pmr::vector<Token>& tokens, std::pmr::memory_resource* resource)
+    : ast(resource), tokens(tokens.begin(), tokens.end(), resource), resource(resource) {}
+
+// Streaming mode: tokens are pulled from the lexer as the grammar needs them.
+Parser::Parser(Lexer& lexer, std::pmr::memory_resource* resource)
+    : ast(resource), tokens(resource), resource(resource), lexer(&lexer) {}
 
 Parser::~Parser() {}
 
-std::vector<std::unique_ptr<Expr>> Parser::parse(){
+std::pmr::vector<ExprPtr> Parser::parse(){
     size_t buffer_size = tokens.size();  
     return program();
 }
 
-std::vector<std::unique_ptr<Expr>> Parser::program() {
-   std::vector<std::unique_ptr<Expr>> stmts;
-    while (peek().type != Token::Type::EOF_TOKEN) {
-        stmts.push_back(expression());
+std::pmr::vector<ExprPtr> Parser::program() {
+   std::pmr::vector<ExprPtr> stmts(resource);
+    while (ExprPtr stmt = next_statement()) {
+        stmts.push_back(std::move(stmt));
     } 
     return stmts;
 }
 
-std::unique_ptr<Expr> Parser::expression() {
+// Parses one top-level statement, or returns null at the end of input. When streaming, the tokens
+// of earlier statements are dropped first, so only the current statement's tokens stay buffered.
+// Statements with syntax errors are skipped when errors go to a Diagnostics list.
+ExprPtr Parser::next_statement() {
+    while (true) {
+        if (lexer) {
+            tokens.erase(tokens.begin(), tokens.begin() + pos);
+            pos = 0;
+        }
+        if (peek().type == Token::Type::EOF_TOKEN) return nullptr;
+        size_t start = pos;
+        if (ExprPtr stmt = expression()) return stmt;
+        synchronize(start);
+    }
+}
+
+// Panic-mode recovery: skips the rest of the failed statement, through the next ';' or up to the
+// next keyword that starts a statement, so one mistake is reported once rather than cascading.
+void Parser::synchronize(size_t start) {
+    panicking = false;
+    // A statement that failed on its first token has to skip it, or it would fail there again
+    if (pos == start) consume();
+    while (peek().type != Token::Type::EOF_TOKEN) {
+        switch (peek().type) {
+            case Token::Type::VAR: case Token::Type::PRINT: case Token::Type::FUN: case Token::Type::CLASS:
+            case Token::Type::FOR: case Token::Type::IF: case Token::Type::WHILE: case Token::Type::RETURN:
+                return;
+            default: break;
+        }
+        if (consume().type == Token::Type::SEMICOLON) return;
+    }
+}
+
+ExprPtr Parser::expression() {
     if (peek().type == Token::Type::PRINT) {
-        Token::Type fun = consume().type;
-        expected(Token::Type::LEFT_PAREN);
-        auto left = equality();
-        expected(Token::Type::RIGHT_PAREN);
-        left = std::make_unique<Function>(std::move(fun), std::move(left));
+        const Token& print = consume();
+        Token::Type fun = print.type;
+        int line = print.line;
+        expected(Token::Type::LEFT_PAREN, "(");
+        if (panicking) return nullptr;
+        auto left = parse_precedence(Precedence::EQUALITY);
+        if (!left) return nullptr;
+        expected(Token::Type::RIGHT_PAREN, ")");
+        if (panicking) return nullptr;
+        left = make_expr<Function>(resource, std::move(fun), std::move(left));
+        left->line = line;
         expected(Token::Type::SEMICOLON, ";");
+        if (panicking) return nullptr;
         return left;
     } else if (peek().type == Token::Type::VAR) {
         consume();
-        Token id = expected(Token::Type::IDENTIFIER);
-        std::string op = expected(Token::Type::EQUAL).lexeme;
-        auto left = equality();
-        left = std::make_unique<Variable>(std::move(id), op, std::move(left));
+        Token id = expected(Token::Type::IDENTIFIER, "identifier");
+        if (panicking) return nullptr;
+        int line = id.line;
+        std::string op = expected(Token::Type::EQUAL, "=").lexeme;
+        if (panicking) return nullptr;
+        auto left = parse_precedence(Precedence::EQUALITY);
+        if (!left) return nullptr;
+        left = make_expr<Variable>(resource, std::move(id), op, std::move(left));
+        left->line = line;
         expected(Token::Type::SEMICOLON, ";");
+        if (panicking) return nullptr;
         return left;
     } else {
-        auto left = equality();
+        auto left = parse_precedence(Precedence::EQUALITY);
+        if (!left) return nullptr;
         expected(Token::Type::SEMICOLON, ";");
+        if (panicking) return nullptr;
         return left;
     }
     return {};
 }
 
-std::unique_ptr<Expr> Parser::equality() {
-    auto left = comparison();
-    
-    while (peek().type == Token::Type::EQUAL_EQUAL || peek().type == Token::Type::BANG_EQUAL) {
-        Token op = consume();
-        auto right = comparison();
-        left = std::make_unique<Binary>(std::move(left), op.lexeme, std::move(right));
+// Operators are parsed by precedence climbing: a token's prefix handler parses the operand it starts,
+// then every following operator that binds at least as tightly as `precedence` folds it into the left
+// side. Binary operators parse their right side one level tighter, which keeps them left-associative.
+constexpr std::array<Parser::ParseRule, static_cast<size_t>(Token::Type::EOF_TOKEN) + 1> Parser::rules = [] {
+    std::array<ParseRule, static_cast<size_t>(Token::Type::EOF_TOKEN) + 1> r{};
+    auto set = [&r](Token::Type type, PrefixFn prefix, InfixFn infix, Precedence precedence) {
+        r[static_cast<size_t>(type)] = {prefix, infix, precedence};
+    };
+    set(Token::Type::LEFT_PAREN,    &Parser::grouping, nullptr,         Precedence::NONE);
+    set(Token::Type::MINUS,         &Parser::unary,    &Parser::binary, Precedence::TERM);
+    set(Token::Type::PLUS,          nullptr,           &Parser::binary, Precedence::TERM);
+    set(Token::Type::SLASH,         nullptr,           &Parser::binary, Precedence::FACTOR);
+    set(Token::Type::STAR,          nullptr,           &Parser::binary, Precedence::FACTOR);
+    set(Token::Type::BANG,          &Parser::unary,    nullptr,         Precedence::NONE);
+    set(Token::Type::BANG_EQUAL,    nullptr,           &Parser::binary, Precedence::EQUALITY);
+    set(Token::Type::EQUAL_EQUAL,   nullptr,           &Parser::binary, Precedence::EQUALITY);
+    set(Token::Type::GREATER,       nullptr,           &Parser::binary, Precedence::COMPARISON);
+    set(Token::Type::GREATER_EQUAL, nullptr,           &Parser::binary, Precedence::COMPARISON);
+    set(Token::Type::LESS,          nullptr,           &Parser::binary, Precedence::COMPARISON);
+    set(Token::Type::LESS_EQUAL,    nullptr,           &Parser::binary, Precedence::COMPARISON);
+    set(Token::Type::NUMBER,        &Parser::number,   nullptr,         Precedence::NONE);
+    set(Token::Type::IDENTIFIER,    &Parser::literal,  nullptr,         Precedence::NONE);
+    set(Token::Type::STRING,        &Parser::literal,  nullptr,         Precedence::NONE);
+    set(Token::Type::TRUE,          &Parser::literal,  nullptr,         Precedence::NONE);
+    set(Token::Type::FALSE,         &Parser::literal,  nullptr,         Precedence::NONE);
+    set(Token::Type::NIL,           &Parser::literal,  nullptr,         Precedence::NONE);
+    return r;
+}();
+
+ExprPtr Parser::parse_precedence(Precedence precedence) {
+    PrefixFn prefix = rules[static_cast<size_t>(peek().type)].prefix;
+    if (!prefix) {
+        err = true;
+        if (diagnostics) {
+            diagnostics->report(peek().line, "Error at '{}': Expected number | ')' | string | boolean", peek().lexeme);
+            panicking = true;
+            return nullptr;
+        }
+        std::string error_msg = std::format("[line {}] Error at '{}': Expected number | ')' | string | boolean", peek().line, peek().lexeme);
+        throw std::runtime_error(error_msg);
     }
+    ExprPtr left = (this->*prefix)();
 
+    while (left && precedence <= rules[static_cast<size_t>(peek().type)].precedence) {
+        left = (this->*rules[static_cast<size_t>(peek().type)].infix)(std::move(left));
+    }
     return left;
 }
 
-std::unique_ptr<Expr> Parser::comparison() {
-    auto left = term();
-    
-    while (peek().type == Token::Type::GREATER || peek().type == Token::Type::GREATER_EQUAL || peek().type == Token::Type::LESS || peek().type == Token::Type::LESS_EQUAL) {
-        Token op = consume();
-        auto right = term();
-        left = std::make_unique<Binary>(std::move(left), op.lexeme, std::move(right));
+ExprPtr Parser::number() {
+    const Token& token = consume();
+    const std::string& digits = std::get<std::string>(token.literal);
+    double value;
+    // A literal too long for a double is the script's mistake, not ours, so it's reported like any
+    // other parse error rather than escaping as std::out_of_range
+    if (std::from_chars(digits.data(), digits.data() + digits.size(), value).ec != std::errc{}) {
+        err = true;
+        if (diagnostics) {
+            diagnostics->report(token.line, "Error at '{}': Number out of range", token.lexeme);
+            panicking = true;
+            return nullptr;
+        }
+        throw std::runtime_error(std::format("[line {}] Error at '{}': Number out of range", token.line, token.lexeme));
     }
-    
-    return left;
+    ExprPtr expr = make_expr<Literal>(resource, value);
+    expr->line = token.line;
+    return expr;
 }
 
-std::unique_ptr<Expr> Parser::term() {
-    auto left = factor();
-    
-    while (peek().type == Token::Type::PLUS || peek().type == Token::Type::MINUS) {
-        Token op = consume();
-        auto right = factor();
-        left = std::make_unique<Binary>(std::move(left), op.lexeme, std::move(right));
+ExprPtr Parser::literal() {
+    const Token& token = consume();
+    ExprPtr expr;
+    switch (token.type) {
+        case Token::Type::IDENTIFIER: expr = make_expr<Literal>(resource, token.lexeme); break;
+        case Token::Type::STRING: expr = make_expr<Literal>(resource, std::get<std::string>(token.literal)); break;
+        case Token::Type::TRUE: expr = make_expr<Literal>(resource, true); break;
+        case Token::Type::FALSE: expr = make_expr<Literal>(resource, false); break;
+        default: expr = make_expr<Literal>(resource, std::monostate{}); break;
     }
-    
-    return left;
+    expr->line = token.line;
+    return expr;
 }
 
-std::unique_ptr<Expr> Parser::factor() {
-    auto left = unary();
-    
-    while (peek().type == Token::Type::STAR || peek().type == Token::Type::SLASH) {
-        Token op = consume();
-        auto right = unary();
-        left = std::make_unique<Binary>(std::move(left), op.lexeme, std::move(right));
-    }
-    
-    return left;
+ExprPtr Parser::grouping() {
+    consume();
+    auto expr = parse_precedence(Precedence::EQUALITY);
+    if (!expr) return nullptr;
+    expected(Token::Type::RIGHT_PAREN, ")");
+    if (panicking) return nullptr;
+    return expr;
 }
 
-std::unique_ptr<Expr> Parser::unary() {
-    if (peek().type == Token::Type::BANG || peek().type == Token::Type::MINUS) {
-        Token op = consume();
-        auto expr = unary();
-        auto left = std::make_unique<Unary>(op.lexeme, std::move(expr));
-        return left;
-    }
-    
-    return primary();
+ExprPtr Parser::unary() {
+    const Token& op = consume();
+    auto expr = parse_precedence(Precedence::UNARY);
+    if (!expr) return nullptr;
+    ExprPtr node = make_expr<Unary>(resource, op.lexeme, std::move(expr));
+    node->line = op.line;
+    return node;
 }
 
-std::unique_ptr<Expr> Parser::primary() {
-    if (peek().type == Token::Type::NUMBER) {
-        double value = std::stod(std::get<std::string>(consume().literal));
-        return std::make_unique<Literal>(value);
-    }
-    if (peek().type == Token::Type::LEFT_PAREN) {
-        consume();
-        auto expr = equality();
-        expected(Token::Type::RIGHT_PAREN, ")");
-        return expr;
-    }
-    if (peek().type == Token::Type::IDENTIFIER) return std::make_unique<Literal>(consume().lexeme);
-    if (peek().type == Token::Type::STRING) return std::make_unique<Literal>(std::get<std::string>(consume().literal));
-    if (peek().type == Token::Type::TRUE) { consume(); return std::make_unique<Literal>(true); }
-    if (peek().type == Token::Type::FALSE) { consume(); return std::make_unique<Literal>(false); }
-    if (peek().type == Token::Type::NIL) { consume(); return std::make_unique<Literal>(std::monostate{}); }
-    
-    err = true;
-    std::string error_msg = std::format("[line {}] Error at '{}': Expected number | ')' | string | boolean", peek().line, peek().lexeme);
-    throw std::runtime_error(error_msg);
+ExprPtr Parser::binary(ExprPtr left) {
+    const Token& op = consume();
+    Precedence precedence = rules[static_cast<size_t>(op.type)].precedence;
+    auto right = parse_precedence(static_cast<Precedence>(static_cast<int>(precedence) + 1));
+    if (!right) return nullptr;
+    ExprPtr node = make_expr<Binary>(resource, std::move(left), op.lexeme, std::move(right));
+    node->line = op.line;
+    return node;
 }
 
 bool Parser::match(Token::Type type) {
@@ -143,19 +226,26 @@ bool Parser::match(Token::Type type) {
     }
 }
 
-Token Parser::expected(Token::Type type, const char* type_s) {
+const Token& Parser::expected(Token::Type type, const char* type_s) {
     if (peek().type == type) {
         return consume();
     } else {
         err = true;
+        // The caller sees panicking set and gives up on the statement; the token is only returned
+        // so it has something to bind to
+        if (diagnostics) {
+            diagnostics->report(peek().line, "Error at '{}': Expected a '{}'", peek().lexeme, type_s);
+            panicking = true;
+            return peek();
+        }
         std::ostringstream oss;
         oss << std::format("[line {}] Error at '{}': Expected a '{}'", peek().line, peek().lexeme, type_s);
         throw std::runtime_error(oss.str());
     }
 }
 
-Token Parser::expect_any(int offset, std::initializer_list<Token::Type> types) {
-    Token t = peek(offset);
+const Token& Parser::expect_any(int offset, std::initializer_list<Token::Type> types) {
+    const Token& t = peek(offset);
     for (auto ty : types) if (t.type == ty) return consume();
     std::ostringstream oss;
     oss << "Expected operator, got '" << t.lexeme;
@@ -163,26 +253,37 @@ Token Parser::expect_any(int offset, std::initializer_list<Token::Type> types) {
 }
 
 bool Parser::check_any(int offset, std::initializer_list<Token::Type> types) {
-    Token t = peek(offset);
+    const Token& t = peek(offset);
     for (auto ty : types) if (t.type == ty) return true;
     return false;
 }
 
-Token Parser::consume() {
-    if (pos >= tokens.size()) {
-        current_token = { Token::Type::EOF_TOKEN, "" };
-        return current_token;
-    }
-    current_token = tokens[pos++];
-    return current_token;
+// Tokens are handed out by reference; past the end every lookup sees this EOF token.
+// The buffer is a deque so pulling more tokens never moves the ones already handed out.
+static const Token EOF_SENTINEL{Token::Type::EOF_TOKEN, ""};
+
+const Token& Parser::consume() {
+    if (!buffer(pos)) return EOF_SENTINEL;
+    return tokens[pos++];
 }
 
-Token Parser::peek(int offset) {
+const Token& Parser::peek(int offset) {
     size_t i = pos + static_cast<size_t>(offset);
-    if (i >= tokens.size()) return { Token::Type::EOF_TOKEN, "" };
+    if (!buffer(i)) return EOF_SENTINEL;
     return tokens[i];
 }
 
+// Makes sure the token at index is buffered, pulling from the lexer when streaming.
+bool Parser::buffer(size_t index) {
+    while (index >= tokens.size()) {
+        if (!lexer) return false;
+        std::optional<Token> token = lexer->next();
+        if (!token) return false;
+        tokens.push_back(std::move(*token));
+    }
+    return true;
+}
+
 // Utility printer for variant
 static void print_value(const std::variant<std::monostate, double, std::string, bool>& v) {
     std::visit([](auto const& x) {
@@ -218,8 +319,8 @@ void Parser::print_ast(const Expr* expr) {
     }
 }
 
-void Parser::print_program(const std::vector<std::unique_ptr<Expr>>& stmts) {
-    for (const std::unique_ptr<Expr>& expr : stmts) {
+void Parser::print_program(const std::pmr::vector<ExprPtr>& stmts) {
+    for (const ExprPtr& expr : stmts) {
         print_ast(expr.get());
         std::cout << std::endl;
     }
@@ -227,4 +328,8 @@ void Parser::print_program(const std::vector<std::unique_ptr<Expr>>& stmts) {
 
 bool Parser::error_check() {
     return err;
+}
+
+void Parser::set_diagnostics(Diagnostics* list) {
+    diagnostics = list;
 }
\ No newline at end of file
@@ -3,10 +3,38 @@
 #include "lexer.h"
 
 struct Expr {
+    // Source line of the token the node was built from, kept for the compiler's line table
+    int line = 0;
     virtual ~Expr() = default;
     //std::unique_ptr<Expr> expr;
 };
 
+// Nodes are allocated from the Parser's memory_resource and deleted through Expr*, so the deleter
+// carries the node's real size and alignment back to the resource.
+struct ExprDeleter {
+    std::pmr::memory_resource* resource = nullptr;
+    size_t size = 0;
+    size_t align = 0;
+
+    void operator()(Expr* node) const {
+        node->~Expr();
+        resource->deallocate(node, size, align);
+    }
+};
+
+using ExprPtr = std::unique_ptr<Expr, ExprDeleter>;
+
+template <typename T, typename... Args>
+ExprPtr make_expr(std::pmr::memory_resource* resource, Args&&... args) {
+    void* memory = resource->allocate(sizeof(T), alignof(T));
+    try {
+        return ExprPtr(new (memory) T(std::forward<Args>(args)...), ExprDeleter{resource, sizeof(T), alignof(T)});
+    } catch (...) {
+        resource->deallocate(memory, sizeof(T), alignof(T));
+        throw;
+    }
+}
+
 // Terminal expressions, Leaf nodes (e.g., 2, 3, 4)
 struct Literal : public Expr {
     std::variant<std::monostate, double, std::string, bool> value;
@@ -16,75 +44,104 @@ struct Literal : public Expr {
 
 // Non-Terminal expressions, Operations nodes (e.g. 2 + 3, 3 * 4)
 struct Binary : public Expr {
-    std::unique_ptr<Expr> left;
+    ExprPtr left;
     std::string op;
-    std::unique_ptr<Expr> right;
+    ExprPtr right;
 
-    Binary(std::unique_ptr<Expr> left, std::string op, std::unique_ptr<Expr> right)
+    Binary(ExprPtr left, std::string op, ExprPtr right)
         : left(std::move(left)), op(std::move(op)), right(std::move(right)) {} 
 };
 
 // ! and - expressions
 struct Unary : public Expr {
     std::string op;
-    std::unique_ptr<Expr> expr;
+    ExprPtr expr;
 
-    Unary(std::string op, std::unique_ptr<Expr> expr)
+    Unary(std::string op, ExprPtr expr)
         : op(std::move(op)), expr(std::move(expr)) {}
 };
 
 struct Function : public Expr {
     Token::Type type;
-    std::unique_ptr<Expr> expr;
+    ExprPtr expr;
 
-    Function(Token::Type type, std::unique_ptr<Expr> expr)
+    Function(Token::Type type, ExprPtr expr)
         : type(std::move(type)), expr(std::move(expr)) {}
 };
 
 struct Variable : public Expr {
     Token left;
     std::string op;
-    std::unique_ptr<Expr> right;
+    ExprPtr right;
 
-    Variable(Token left, std::string op, std::unique_ptr<Expr> right)
+    Variable(Token left, std::string op, ExprPtr right)
         : left(std::move(left)), op(std::move(op)), right(std::move(right)) {} 
 };
 
+// Binding power of an operator, from loosest to tightest.
+enum class Precedence {
+    NONE, EQUALITY, COMPARISON, TERM, FACTOR, UNARY, PRIMARY
+};
+
 class Parser {
     private:
-        std::vector<std::unique_ptr<Expr>> ast;
-        std::vector<Token> tokens;
-        Token current_token;
+        using PrefixFn = ExprPtr (Parser::*)();
+        using InfixFn = ExprPtr (Parser::*)(ExprPtr left);
+
+        // How a token parses when it starts an expression and when it follows one
+        struct ParseRule {
+            PrefixFn prefix;
+            InfixFn infix;
+            Precedence precedence;
+        };
+        static const std::array<ParseRule, static_cast<size_t>(Token::Type::EOF_TOKEN) + 1> rules;
+
+        std::pmr::vector<ExprPtr> ast;
+        std::pmr::deque<Token> tokens;
+        std::pmr::memory_resource* resource;
+        Lexer* lexer = nullptr;
         std::vector<Token::Type> operators = {Token::Type::PLUS, Token::Type::MINUS, Token::Type::SLASH, Token::Type::STAR};
 
         size_t pos = 0;
         bool err = false;
+        // With a Diagnostics list, syntax errors are recorded there instead of thrown, and the
+        // statement that failed is abandoned until synchronize() finds the start of the next one
+        Diagnostics* diagnostics = nullptr;
+        bool panicking = false;
+
+        void synchronize(size_t start);
 
     public:
-        Parser(const std::vector<Token>& tokens);
+        Parser(const std::pmr::vector<Token>& tokens, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+        Parser(Lexer& lexer, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
         ~Parser();
 
-        std::vector<std::unique_ptr<Expr>> parse();
+        std::pmr::vector<ExprPtr> parse();
         bool match(Token::Type type);
         bool check_any(int offset, std::initializer_list<Token::Type> types);
 
         // Grammar rule
-        std::vector<std::unique_ptr<Expr>> program();
-        std::unique_ptr<Expr> expression();
-        std::unique_ptr<Expr> equality();
-        std::unique_ptr<Expr> comparison();
-        std::unique_ptr<Expr> term();
-        std::unique_ptr<Expr> factor();
-        std::unique_ptr<Expr> unary();
-        std::unique_ptr<Expr> primary();
+        std::pmr::vector<ExprPtr> program();
+        ExprPtr next_statement();
+        ExprPtr expression();
+        ExprPtr parse_precedence(Precedence precedence);
+
+        // Pratt handlers, dispatched through rules
+        ExprPtr number();
+        ExprPtr literal();
+        ExprPtr grouping();
+        ExprPtr unary();
+        ExprPtr binary(ExprPtr left);
 
         void print_ast(const Expr* expr);
-        void print_program(const std::vector<std::unique_ptr<Expr>>& stmts);
+        void print_program(const std::pmr::vector<ExprPtr>& stmts);
         
-        Token consume();
-        Token peek(int offset = 0);
-        Token expected(Token::Type type, const char* type_s = "default");
-        Token expect_any(int offset, std::initializer_list<Token::Type> types);
+        const Token& consume();
+        const Token& peek(int offset = 0);
+        bool buffer(size_t index);
+        const Token& expected(Token::Type type, const char* type_s = "default");
+        const Token& expect_any(int offset, std::initializer_list<Token::Type> types);
 
         bool error_check();
+        void set_diagnostics(Diagnostics* list);
 };
\ No newline at end of file
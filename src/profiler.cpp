@@ -0,0 +1,81 @@
+#include "profiler.h"
+#include <map>
+#if defined(__unix__)
+#include <csignal>
+#include <sys/time.h>
+#endif
+
+// SIGPROF fires every interval of CPU time the process uses. The handler only reads the offset the
+// VM last published and bumps that offset's counter, both lock-free atomics, so it's safe to run
+// at any point in the interpreter. Offsets are turned into lines once, after profiling stops.
+
+static std::atomic<Profiler*> active{nullptr};
+#if defined(__unix__)
+static struct sigaction previous;
+#endif
+
+Profiler::Profiler(const Program& program, const std::atomic<size_t>& ip, std::chrono::microseconds interval)
+    : program(program), ip(ip), interval(interval), samples(program.bytecode.size()) {}
+
+Profiler::~Profiler() {
+    stop();
+}
+
+void Profiler::on_sample(int) {
+    Profiler* profiler = active.load(std::memory_order_relaxed);
+    if (!profiler) return;
+    size_t offset = profiler->ip.load(std::memory_order_relaxed);
+    if (offset < profiler->samples.size()) profiler->samples[offset].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Profiler::start() {
+#if defined(__unix__)
+    Profiler* expected = nullptr;
+    if (!active.compare_exchange_strong(expected, this)) throw std::runtime_error("Another profiler is already running.");
+
+    struct sigaction action{};
+    action.sa_handler = &Profiler::on_sample;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, &previous);
+
+    itimerval timer{};
+    timer.it_interval.tv_sec = interval.count() / 1000000;
+    timer.it_interval.tv_usec = interval.count() % 1000000;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    running = true;
+#else
+    throw std::runtime_error("Profiling needs POSIX interval timers.");
+#endif
+}
+
+void Profiler::stop() {
+#if defined(__unix__)
+    if (!running) return;
+    itimerval timer{};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    sigaction(SIGPROF, &previous, nullptr);
+    active.store(nullptr);
+    running = false;
+#endif
+}
+
+uint64_t Profiler::total_samples() {
+    uint64_t total = 0;
+    for (const std::atomic<uint64_t>& count : samples) total += count.load(std::memory_order_relaxed);
+    return total;
+}
+
+// Writes one "script;line N count" record per sampled line, the folded format flamegraph.pl and
+// speedscope read.
+void Profiler::write_folded(std::ostream& out, std::string_view script) {
+    std::map<uint32_t, uint64_t> lines;
+    for (size_t offset = 0; offset < samples.size(); offset++) {
+        uint64_t count = samples[offset].load(std::memory_order_relaxed);
+        if (count) lines[program.line_at(offset)] += count;
+    }
+    for (const auto& [line, count] : lines) {
+        out << std::format("{};line {} {}\n", script, line, count);
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "compiler.h"
+#include <atomic>
+#include <chrono>
+
+// Samples which instruction a VM is running on a CPU-time timer and maps the samples back to
+// script lines through the Program's line table. The timer signal is process-wide, so only one
+// profiler can be running at a time.
+class Profiler {
+    private:
+        const Program& program;
+        const std::atomic<size_t>& ip;
+        std::chrono::microseconds interval;
+        // Sample counts per bytecode offset, allocated up front since the signal handler can't
+        std::vector<std::atomic<uint64_t>> samples;
+        bool running = false;
+
+        static void on_sample(int signal);
+
+    public:
+        static constexpr std::chrono::microseconds DEFAULT_INTERVAL{1000};
+
+        Profiler(const Program& program, const std::atomic<size_t>& ip,
+                 std::chrono::microseconds interval = DEFAULT_INTERVAL);
+        ~Profiler();
+
+        void start();
+        void stop();
+        uint64_t total_samples();
+        void write_folded(std::ostream& out, std::string_view script);
+};
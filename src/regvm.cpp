@@ -0,0 +1,231 @@
+#include "regvm.h"
+
+// Lowering replays the stack the bytecode would build, but with registers on it rather than values.
+// A slot's temporary register is fixed by its depth, which is the whole register allocator: a
+// statement's values never outlive it, so depth alone says which temporaries are live.
+//
+// Operands that name a variable's register are only read when the instruction using them runs, so
+// a DEF to that variable in between would change them. Before such a DEF, the pending operand is
+// copied into its own temporary first.
+
+static RegisterVM::Op binary_op(uint8_t op) {
+    switch (op) {
+        case ADD: case ADD_NUM: case ADD_CONST: return RegisterVM::Op::ADD;
+        case SUB: case SUB_NUM: case SUB_CONST: return RegisterVM::Op::SUB;
+        case MUL: case MUL_NUM: case MUL_CONST: return RegisterVM::Op::MUL;
+        case DIV: case DIV_NUM: case DIV_CONST: return RegisterVM::Op::DIV;
+        case GRT: case GRT_NUM: case VAR_GRT_CONST: return RegisterVM::Op::GRT;
+        case GRTE: case GRTE_NUM: case VAR_GRTE_CONST: return RegisterVM::Op::GRTE;
+        case LSS: case LSS_NUM: case VAR_LSS_CONST: return RegisterVM::Op::LSS;
+        default: return RegisterVM::Op::LSSE;
+    }
+}
+
+RegisterVM::RegisterVM(const Program& program) : program(program) {}
+
+RegisterVM::~RegisterVM() {}
+
+// Lowers the whole program. Returns false, with the reason in get_error(), if any part of it has
+// to run on the stack VM.
+bool RegisterVM::compile() {
+    compiled = false;
+    code.clear();
+    stack.clear();
+    globals_at = program.constant_pool.size();
+    temporaries_at = globals_at + program.variable_pool.size();
+    temporary_count = 0;
+
+    const std::pmr::vector<uint8_t>& bytecode = program.bytecode;
+    // A rough guess: most instructions are two bytes long and CON and VAR lower to nothing
+    code.reserve(bytecode.size() / 2 + 1);
+    for (size_t i = 0; i < bytecode.size(); i += op_length(bytecode[i])) {
+        if (!lower(i)) return false;
+    }
+
+    registers.assign(temporaries_at + temporary_count, lib::Value());
+    std::copy(program.constant_pool.begin(), program.constant_pool.end(), registers.begin());
+    verified = Verifier(program).verify();
+    compiled = true;
+    return true;
+}
+
+bool RegisterVM::lower(size_t offset) {
+    const std::pmr::vector<uint8_t>& bytecode = program.bytecode;
+    uint8_t op = bytecode[offset];
+    auto constant = [&](size_t at) { return Operand{bytecode[at], NO_PRODUCER}; };
+    auto global = [&](size_t at) { return Operand{static_cast<uint16_t>(globals_at + bytecode[at]), NO_PRODUCER}; };
+
+    if (temporaries_at + stack.size() + 1 > UINT16_MAX) return fail(offset, "More registers than an operand can name");
+    // Unverified programs can underflow, and the stack VM's checked loop is what reports that
+    if (stack.size() < operand_count(op)) return fail(offset, "Stack underflow");
+
+    switch (op)
+    {
+        case CON: stack.push_back(constant(offset + 1)); break;
+        case VAR: stack.push_back(global(offset + 1)); break;
+        case ADD: case SUB: case MUL: case DIV:
+        case GRT: case GRTE: case LSS: case LSSE:
+        case ADD_NUM: case SUB_NUM: case MUL_NUM: case DIV_NUM:
+        case GRT_NUM: case GRTE_NUM: case LSS_NUM: case LSSE_NUM: {
+            Operand b = stack.back();
+            stack.pop_back();
+            Operand a = stack.back();
+            stack.pop_back();
+            emit_binary(binary_op(op), a, b);
+            break;
+        }
+        case ADD_CONST: case SUB_CONST: case MUL_CONST: case DIV_CONST: {
+            Operand a = stack.back();
+            stack.pop_back();
+            emit_binary(binary_op(op), a, constant(offset + 1));
+            break;
+        }
+        case VAR_GRT_CONST: case VAR_GRTE_CONST: case VAR_LSS_CONST: case VAR_LSSE_CONST:
+            emit_binary(binary_op(op), global(offset + 1), constant(offset + 2));
+            break;
+        case DEF: {
+            uint16_t target = global(offset + 1).reg;
+            Operand value = stack.back();
+            stack.pop_back();
+            for (size_t slot = 0; slot < stack.size(); slot++) {
+                if (stack[slot].reg != target) continue;
+                uint16_t copy = static_cast<uint16_t>(temporaries_at + slot);
+                code.push_back({Op::MOVE, copy, target, 0});
+                stack[slot] = {copy, code.size() - 1};
+            }
+            // The value was computed just for this store, so it's computed straight into the variable
+            if (value.producer != NO_PRODUCER && value.producer == code.size() - 1) code.back().dst = target;
+            else code.push_back({Op::MOVE, target, value.reg, 0});
+            break;
+        }
+        case PRINT:
+            code.push_back({Op::PRINT, 0, stack.back().reg, 0});
+            stack.pop_back();
+            break;
+        case PRINT_RETURN:
+            code.push_back({Op::PRINTLN, 0, stack.back().reg, 0});
+            stack.clear();
+            break;
+        case RETURN:
+            code.push_back({Op::NEWLINE, 0, 0, 0});
+            stack.clear();
+            break;
+        default: return fail(offset, "Opcode not supported by the register VM");
+    }
+    return true;
+}
+
+// Writes a <op> b into the temporary of the slot the result lands in and pushes it.
+void RegisterVM::emit_binary(Op op, Operand a, Operand b) {
+    uint16_t dst = static_cast<uint16_t>(temporaries_at + stack.size());
+    code.push_back({op, dst, a.reg, b.reg});
+    stack.push_back({dst, code.size() - 1});
+    temporary_count = std::max(temporary_count, stack.size());
+}
+
+bool RegisterVM::fail(size_t offset, const char* reason) {
+    error = std::format("[offset {}] {}", offset, reason);
+    return false;
+}
+
+void RegisterVM::execute() {
+    if (!compiled) throw std::runtime_error("Register code executed before a successful compile.");
+    verified ? run<false>() : run<true>();
+}
+
+template <bool checked>
+void RegisterVM::run() {
+    lib::Value* r = registers.data();
+
+    for (const Instruction& in : code)
+    {
+        instructions++;
+        switch (in.op)
+        {
+            case Op::ADD: {
+                // Strings are legal here even in verified programs, so the type is always checked
+                const double* a = std::get_if<double>(&r[in.a]);
+                const double* b = std::get_if<double>(&r[in.b]);
+                if (a && b) {
+                    r[in.dst] = *a + *b;
+                    break;
+                }
+                const lib::String* sa = std::get_if<lib::String>(&r[in.a]);
+                const lib::String* sb = std::get_if<lib::String>(&r[in.b]);
+                if (!sa || !sb) throw std::runtime_error("Operands must be two numbers or two strings.");
+                r[in.dst] = heap.concat(*sa, *sb);
+                if (heap.should_collect()) collect_garbage();
+                break;
+            }
+            case Op::SUB: case Op::MUL: case Op::DIV:
+            case Op::GRT: case Op::GRTE: case Op::LSS: case Op::LSSE: {
+                const double* pa = std::get_if<double>(&r[in.a]);
+                const double* pb = std::get_if<double>(&r[in.b]);
+                if constexpr (!checked) { [[assume(pa && pb)]]; }
+                if (!pa || !pb) throw std::runtime_error("Operands must be numbers.");
+                double a = *pa, b = *pb;
+                switch (in.op) {
+                    case Op::SUB: r[in.dst] = a - b; break;
+                    case Op::MUL: r[in.dst] = a * b; break;
+                    case Op::DIV: r[in.dst] = a / b; break;
+                    case Op::GRT: r[in.dst] = a > b; break;
+                    case Op::GRTE: r[in.dst] = a >= b; break;
+                    case Op::LSS: r[in.dst] = a < b; break;
+                    default: r[in.dst] = a <= b; break;
+                }
+                break;
+            }
+            case Op::MOVE: r[in.dst] = r[in.a]; break;
+            case Op::PRINT: print(r[in.a]); break;
+            case Op::PRINTLN: print(r[in.a]); *out << "\n"; break;
+            case Op::NEWLINE: *out << "\n"; break;
+        }
+    }
+}
+
+void RegisterVM::print(const lib::Value& value) {
+    if (auto v = std::get_if<lib::String>(&value)) {
+        *out << *v;
+    } else if (auto v = std::get_if<double>(&value)) {
+        *out << std::to_string(*v);
+    } else if (auto v = std::get_if<bool>(&value)) {
+        *out << std::to_string(*v);
+    }
+}
+
+// Every register is a root: stale temporaries only keep a string alive a little longer.
+void RegisterVM::collect_garbage() {
+    for (const lib::Value& v : registers) heap.mark(v);
+    heap.collect();
+}
+
+// Instructions executed over the VM's lifetime.
+uint64_t RegisterVM::get_instructions() {
+    return instructions;
+}
+
+void RegisterVM::set_output(std::ostream& output) {
+    out = &output;
+}
+
+void RegisterVM::print_code() {
+    static constexpr const char* NAMES[] = {"ADD", "SUB", "MUL", "DIV", "GRT", "LSS", "GRTE", "LSSE", "MOVE", "PRINT", "PRINTLN", "NEWLINE"};
+    auto name = [&](uint16_t reg) {
+        if (reg < globals_at) return std::format("k{}", reg);
+        if (reg < temporaries_at) return std::string(program.variable_pool[reg - globals_at].str());
+        return std::format("r{}", reg - temporaries_at);
+    };
+    std::cout << "Registers: " << globals_at << " constants, " << temporaries_at - globals_at << " globals, "
+              << temporary_count << " temporaries\n";
+    for (const Instruction& in : code) {
+        std::cout << "  " << NAMES[static_cast<size_t>(in.op)];
+        if (in.op <= Op::LSSE) std::cout << " " << name(in.dst) << ", " << name(in.a) << ", " << name(in.b);
+        else if (in.op == Op::MOVE) std::cout << " " << name(in.dst) << ", " << name(in.a);
+        else if (in.op != Op::NEWLINE) std::cout << " " << name(in.a);
+        std::cout << "\n";
+    }
+}
+
+const std::string& RegisterVM::get_error() {
+    return error;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "compiler.h"
+#include "verifier.h"
+#include "gc.h"
+
+// Runs a Program as three-address code over a flat register file instead of a value stack.
+// compile() lowers the bytecode once: every stack slot becomes a temporary register, and variables
+// and constants are registers of their own, so VAR and CON disappear into the operands of the
+// instructions that use them and a DEF becomes the destination of the instruction that computed
+// its value. Programs using instructions it doesn't lower are left to the stack VM.
+class RegisterVM {
+    public:
+        enum class Op : uint8_t { ADD, SUB, MUL, DIV, GRT, LSS, GRTE, LSSE, MOVE, PRINT, PRINTLN, NEWLINE };
+
+        // dst = a <op> b; MOVE copies a, PRINT and PRINTLN print a, NEWLINE has no operands
+        struct Instruction {
+            Op op;
+            uint16_t dst;
+            uint16_t a;
+            uint16_t b;
+        };
+
+    private:
+        // A value on the compile-time stack: the register holding it and the instruction that
+        // wrote it, if any
+        struct Operand {
+            uint16_t reg;
+            size_t producer;
+        };
+        static constexpr size_t NO_PRODUCER = SIZE_MAX;
+
+        const Program& program;
+        std::vector<Instruction> code;
+        std::vector<Operand> stack;
+        // Constants, then globals, then one temporary per stack slot
+        std::vector<lib::Value> registers;
+        size_t globals_at = 0;
+        size_t temporaries_at = 0;
+        size_t temporary_count = 0;
+        uint64_t instructions = 0;
+        std::ostream* out = &std::cout;
+        bool compiled = false;
+        bool verified = false;
+        std::string error;
+        Heap heap;
+
+        bool fail(size_t offset, const char* reason);
+        bool lower(size_t offset);
+        void emit_binary(Op op, Operand a, Operand b);
+        void print(const lib::Value& value);
+        void collect_garbage();
+
+        template <bool checked>
+        void run();
+
+    public:
+        RegisterVM(const Program& program);
+        ~RegisterVM();
+
+        bool compile();
+        void execute();
+        uint64_t get_instructions();
+        void set_output(std::ostream& output);
+        void print_code();
+        const std::string& get_error();
+};
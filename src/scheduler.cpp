@@ -0,0 +1,67 @@
+#include "scheduler.h"
+
+// Tasks are dealt round-robin onto one queue per worker before any thread starts, so workers never
+// share a queue and need no locking. VMs share nothing mutable: each has its own globals, stack and
+// heap, and the only common state, the intern table, has its own lock. Programs run here must be
+// allocated from a thread-safe memory_resource, since their VMs allocate from it too.
+
+Scheduler::Task::Task(std::string name, Program&& program)
+    : name(std::move(name)), program(std::move(program)), vm(this->program) {
+    vm.set_output(output);
+}
+
+Scheduler::Scheduler(size_t workers, size_t slice) : workers(workers), slice(slice) {}
+
+Scheduler::~Scheduler() {}
+
+Scheduler::Task& Scheduler::add(std::string name, Program&& program) {
+    tasks.push_back(std::make_unique<Task>(std::move(name), std::move(program)));
+    return *tasks.back();
+}
+
+// Runs every task to completion, or to its first runtime error.
+void Scheduler::run() {
+    if (tasks.empty()) return;
+    std::vector<std::deque<Task*>> queues(std::min(workers, tasks.size()));
+    for (size_t i = 0; i < tasks.size(); i++) queues[i % queues.size()].push_back(tasks[i].get());
+
+    auto started = std::chrono::steady_clock::now();
+    std::vector<std::jthread> threads;
+    for (std::deque<Task*>& queue : queues) {
+        threads.emplace_back(&Scheduler::work, this, std::move(queue), started);
+    }
+}
+
+void Scheduler::work(std::deque<Task*> queue, std::chrono::steady_clock::time_point started) {
+    for (Task* task : queue) task->vm.start();
+
+    while (!queue.empty()) {
+        Task* task = queue.front();
+        queue.pop_front();
+        try {
+            task->slices++;
+            if (!task->vm.resume(slice)) {
+                queue.push_back(task);
+                continue;
+            }
+        } catch (const std::exception& e) {
+            task->error = e.what();
+        }
+        task->latency = std::chrono::steady_clock::now() - started;
+    }
+}
+
+const std::vector<std::unique_ptr<Scheduler::Task>>& Scheduler::get_tasks() {
+    return tasks;
+}
+
+void Scheduler::print_report() {
+    std::cout << std::format("[Scheduler] {} VMs on {} threads, {} instruction slices\n",
+        tasks.size(), std::min(workers, tasks.size()), slice);
+    for (const std::unique_ptr<Task>& task : tasks) {
+        std::cout << std::format("  {}: {} instructions, {} slices, finished after {:.3f} ms{}\n",
+            task->name, task->vm.get_instructions(), task->slices,
+            std::chrono::duration<double, std::milli>(task->latency).count(),
+            task->error.empty() ? "" : ", failed: " + task->error);
+    }
+}
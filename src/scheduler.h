@@ -0,0 +1,42 @@
+#pragma once
+#include "vm.h"
+#include <chrono>
+#include <thread>
+
+// Runs many independent programs on a fixed pool of threads. Each VM runs a slice of instructions
+// at a time and then goes to the back of its thread's run queue, so a long script only holds its
+// thread for one slice per turn instead of until it ends.
+class Scheduler {
+    public:
+        static constexpr size_t DEFAULT_SLICE = 10000;
+
+        struct Task {
+            std::string name;
+            Program program;
+            VM vm;
+            // Each VM prints into its own buffer, so scripts sharing a thread don't interleave
+            std::ostringstream output;
+            uint64_t slices = 0;
+            // From the scheduler starting to the task finishing
+            std::chrono::nanoseconds latency{0};
+            std::string error;
+
+            Task(std::string name, Program&& program);
+        };
+
+    private:
+        std::vector<std::unique_ptr<Task>> tasks;
+        size_t workers;
+        size_t slice;
+
+        void work(std::deque<Task*> queue, std::chrono::steady_clock::time_point started);
+
+    public:
+        Scheduler(size_t workers = std::max(1u, std::thread::hardware_concurrency()), size_t slice = DEFAULT_SLICE);
+        ~Scheduler();
+
+        Task& add(std::string name, Program&& program);
+        void run();
+        const std::vector<std::unique_ptr<Task>>& get_tasks();
+        void print_report();
+};
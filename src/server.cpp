@@ -0,0 +1,178 @@
+#include "server.h"
+#include <fstream>
+#include <cstring>
+#if defined(__unix__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// The cache is a list in recency order plus a hash index into it, so a hit moves its entry to the
+// front in constant time and the least recently used program is always at the back. Entries keep
+// their source text, so two scripts whose hashes collide are never mistaken for each other.
+
+Server::Server(size_t capacity) : capacity(std::max<size_t>(capacity, 1)) {}
+
+Server::~Server() {}
+
+Program& Server::lookup(const std::string& source) {
+    size_t hash = std::hash<std::string>{}(source);
+    auto it = index.find(hash);
+    if (it != index.end() && it->second->source == source) {
+        stats.hits++;
+        entries.splice(entries.begin(), entries, it->second);
+        return entries.front().program;
+    }
+    stats.misses++;
+
+    Program program = compile_program(source);
+
+    // A colliding entry is replaced rather than chained
+    if (it != index.end()) entries.erase(it->second);
+    else if (entries.size() == capacity) {
+        index.erase(entries.back().hash);
+        entries.pop_back();
+        stats.evictions++;
+    }
+    entries.push_front(Entry{hash, source, std::move(program)});
+    index[hash] = entries.begin();
+    if (lib::interned_count() >= next_sweep) sweep_interned();
+    return entries.front().program;
+}
+
+// Runs between requests, when no VM is alive, so the cached programs' pools hold every interned
+// string still in use.
+void Server::sweep_interned() {
+    std::vector<lib::String> roots;
+    for (const Entry& entry : entries) {
+        for (const lib::Value& constant : entry.program.constant_pool) {
+            if (auto s = std::get_if<lib::String>(&constant)) roots.push_back(*s);
+        }
+        roots.insert(roots.end(), entry.program.variable_pool.begin(), entry.program.variable_pool.end());
+    }
+    stats.interned_freed += lib::sweep_interned(roots);
+    next_sweep = std::max(MIN_INTERNED, 2 * lib::interned_count());
+}
+
+std::string Server::run(const std::string& source) {
+    Program& program = lookup(source);
+    std::ostringstream output;
+    VM vm(program);
+    vm.set_output(output);
+    vm.execute();
+    return output.str();
+}
+
+std::string Server::report() {
+    uint64_t lookups = stats.hits + stats.misses;
+    return std::format("requests {}\nhits {}\nmisses {}\nhit_rate {:.3f}\nevictions {}\ncached {}\nerrors {}\n"
+                       "interned {}\ninterned_freed {}\nmean_latency_us {:.1f}\nmax_latency_us {:.1f}\n",
+        stats.requests, stats.hits, stats.misses, lookups ? double(stats.hits) / lookups : 0.0,
+        stats.evictions, entries.size(), stats.errors, lib::interned_count(), stats.interned_freed,
+        stats.requests ? std::chrono::duration<double, std::micro>(stats.total_latency).count() / stats.requests : 0.0,
+        std::chrono::duration<double, std::micro>(stats.max_latency).count());
+}
+
+// Answers one request line. Returns nothing when the client asked to end the session.
+std::optional<std::string> Server::handle(const std::string& request) {
+    auto started = std::chrono::steady_clock::now();
+    size_t space = request.find(' ');
+    std::string command = request.substr(0, space);
+    std::string argument = space == std::string::npos ? "" : request.substr(space + 1);
+
+    if (command == "quit") return std::nullopt;
+
+    bool ok = true;
+    std::string body;
+    try {
+        if (command == "run") {
+            std::ifstream file(argument);
+            if (!file.is_open()) throw std::runtime_error("Error reading file: " + argument);
+            std::stringstream buffer;
+            buffer << file.rdbuf();
+            body = run(buffer.str());
+        } else if (command == "eval") {
+            body = run(argument);
+        } else if (command == "stats") {
+            body = report();
+        } else {
+            throw std::runtime_error("Unknown request: " + command);
+        }
+    } catch (const std::exception& e) {
+        ok = false;
+        body = e.what();
+        stats.errors++;
+    }
+
+    auto latency = std::chrono::steady_clock::now() - started;
+    if (command != "stats") {
+        stats.requests++;
+        stats.total_latency += latency;
+        stats.max_latency = std::max<std::chrono::nanoseconds>(stats.max_latency, latency);
+    }
+    return std::format("{} {} {}\n", ok ? "OK" : "ERROR", body.size(),
+        std::chrono::duration_cast<std::chrono::microseconds>(latency).count()) + body;
+}
+
+void Server::serve(std::istream& in, std::ostream& out) {
+    std::string line;
+    while (std::getline(in, line)) {
+        std::optional<std::string> response = handle(line);
+        if (!response) break;
+        out << *response << std::flush;
+    }
+}
+
+// Accepts one client at a time on a Unix domain socket and speaks the same line protocol to each.
+// A client's quit only closes its own connection.
+void Server::serve(const std::string& socket_path) {
+#if defined(__unix__)
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (listener < 0 || socket_path.size() >= sizeof(address.sun_path)) throw std::runtime_error("Couldn't create socket: " + socket_path);
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    unlink(socket_path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listener, 16) < 0) {
+        close(listener);
+        throw std::runtime_error("Couldn't listen on socket: " + socket_path);
+    }
+
+    while (true) {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0) continue;
+
+        std::string pending;
+        char chunk[4096];
+        bool open = true;
+        while (open) {
+            ssize_t received = read(client, chunk, sizeof(chunk));
+            if (received <= 0) break;
+            pending.append(chunk, static_cast<size_t>(received));
+
+            size_t newline;
+            while (open && (newline = pending.find('\n')) != std::string::npos) {
+                std::optional<std::string> response = handle(pending.substr(0, newline));
+                pending.erase(0, newline + 1);
+                if (!response) {
+                    open = false;
+                    break;
+                }
+                for (size_t sent = 0; sent < response->size();) {
+                    // MSG_NOSIGNAL so a client hanging up mid-reply can't kill the server with SIGPIPE
+                    ssize_t written = send(client, response->data() + sent, response->size() - sent, MSG_NOSIGNAL);
+                    if (written <= 0) { open = false; break; }
+                    sent += static_cast<size_t>(written);
+                }
+            }
+        }
+        close(client);
+    }
+#else
+    throw std::runtime_error("Unix sockets aren't available on this platform.");
+#endif
+}
+
+const Server::Stats& Server::get_stats() {
+    return stats;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "lexer.h"
+#include "parser.h"
+#include "compiler.h"
+#include "vm.h"
+#include <chrono>
+#include <list>
+
+// Runs scripts on request in one long-lived process. Compiled programs are kept in an LRU cache
+// keyed by a hash of their source, so a script seen before skips the whole front end; every request
+// still gets a fresh VM, so no state leaks from one run to the next.
+//
+// Requests are single lines:
+//      run <path>      runs the script at path
+//      eval <source>   runs the rest of the line as a script
+//      stats           reports cache and latency counters
+//      quit            ends the session
+// and each reply is "OK <bytes> <microseconds>" or "ERROR <bytes> <microseconds>" on its own line,
+// followed by exactly <bytes> bytes of script output or error message.
+//
+// Compiling interns every identifier, string literal and CSE temporary for good, so a server fed
+// ever new sources would grow without bound. Whenever the intern table has doubled since the last
+// sweep, strings none of the cached programs use are freed, which keeps it within a small multiple
+// of what the cache itself needs.
+class Server {
+    public:
+        static constexpr size_t DEFAULT_CAPACITY = 64;
+        // Intern table size below which it's never swept
+        static constexpr size_t MIN_INTERNED = 4096;
+
+        struct Stats {
+            uint64_t requests = 0;
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t evictions = 0;
+            uint64_t errors = 0;
+            uint64_t interned_freed = 0;
+            std::chrono::nanoseconds total_latency{0};
+            std::chrono::nanoseconds max_latency{0};
+        };
+
+    private:
+        struct Entry {
+            size_t hash;
+            std::string source;
+            Program program;
+        };
+
+        size_t capacity;
+        // Most recently used first
+        std::list<Entry> entries;
+        std::unordered_map<size_t, std::list<Entry>::iterator> index;
+        Stats stats;
+        size_t next_sweep = MIN_INTERNED;
+
+        Program& lookup(const std::string& source);
+        void sweep_interned();
+        std::string run(const std::string& source);
+        std::string report();
+
+    public:
+        Server(size_t capacity = DEFAULT_CAPACITY);
+        ~Server();
+
+        std::optional<std::string> handle(const std::string& request);
+        void serve(std::istream& in, std::ostream& out);
+        void serve(const std::string& socket_path);
+        const Stats& get_stats();
+};
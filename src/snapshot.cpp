@@ -0,0 +1,118 @@
+#include "snapshot.h"
+#include <bit>
+#include <cstring>
+#include <fstream>
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Loading maps the file and decodes the fixed-size records in place, with no read() copies and no
+// parsing. Strings are interned straight from the mapping, since every Program and VM expects
+// strings it didn't allocate itself to be interned, and the mapping is released once they are.
+
+void Snapshot::write(const std::string& path, const Program& program, std::span<const lib::Value> globals) {
+    std::string strings;
+    auto record = [&](const lib::Value& value) {
+        if (auto v = std::get_if<double>(&value)) return Record{Record::NUMBER, 0, std::bit_cast<uint64_t>(*v)};
+        if (auto v = std::get_if<bool>(&value)) return Record{Record::BOOL, 0, *v ? 1u : 0u};
+        std::string_view chars = std::get<lib::String>(value).str();
+        Record string{Record::STRING, static_cast<uint32_t>(chars.size()), strings.size()};
+        strings += chars;
+        return string;
+    };
+
+    std::vector<Record> records;
+    for (const lib::String& name : program.variable_pool) records.push_back(record(name));
+    for (size_t v = 0; v < program.variable_pool.size(); v++) {
+        records.push_back(record(v < globals.size() ? globals[v] : lib::Value(0.0)));
+    }
+    for (const lib::Value& constant : program.constant_pool) records.push_back(record(constant));
+
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.variable_count = static_cast<uint32_t>(program.variable_pool.size());
+    header.constant_count = static_cast<uint32_t>(program.constant_pool.size());
+    header.string_bytes = strings.size();
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) throw std::runtime_error("Error writing file: " + path);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(Record));
+    file.write(strings.data(), strings.size());
+    if (!file) throw std::runtime_error("Error writing file: " + path);
+}
+
+Snapshot::Snapshot(const std::string& path) {
+#if defined(__unix__)
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info{};
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        if (fd >= 0) close(fd);
+        throw std::runtime_error("Error reading file: " + path);
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    void* mapping = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (mapping == MAP_FAILED) throw std::runtime_error("Couldn't map snapshot: " + path);
+
+    const char* data = static_cast<const char*>(mapping);
+    auto corrupt = [&]() {
+        munmap(mapping, size);
+        return std::runtime_error("Not a valid snapshot: " + path);
+    };
+    Header header;
+    if (size < sizeof(header)) throw corrupt();
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) throw corrupt();
+    // Sizes come from the file, so every comparison subtracts from what's known to fit rather than
+    // adding values that could wrap around
+    size_t count = size_t(header.variable_count) * 2 + header.constant_count;
+    if (count > (size - sizeof(header)) / sizeof(Record)) throw corrupt();
+    size_t strings_at = sizeof(header) + count * sizeof(Record);
+    if (header.string_bytes != size - strings_at) throw corrupt();
+
+    const Record* records = reinterpret_cast<const Record*>(data + sizeof(header));
+    std::string_view strings(data + strings_at, header.string_bytes);
+    auto value = [&](const Record& record) -> std::optional<lib::Value> {
+        switch (record.tag) {
+            case Record::NUMBER: return std::bit_cast<double>(record.payload);
+            case Record::BOOL: return record.payload != 0;
+            case Record::STRING:
+                if (record.payload > strings.size() || record.length > strings.size() - record.payload) return std::nullopt;
+                return lib::intern(strings.substr(record.payload, record.length));
+            default: return std::nullopt;
+        }
+    };
+
+    for (size_t i = 0; i < count; i++) {
+        std::optional<lib::Value> decoded = value(records[i]);
+        if (!decoded) throw corrupt();
+        if (i < header.variable_count) {
+            if (!std::holds_alternative<lib::String>(*decoded)) throw corrupt();
+            variables.push_back(std::get<lib::String>(*decoded));
+        }
+        else if (i < size_t(header.variable_count) * 2) globals.push_back(*decoded);
+        else constants.push_back(*decoded);
+    }
+    munmap(mapping, size);
+#else
+    throw std::runtime_error("Snapshots need mmap.");
+#endif
+}
+
+Snapshot::~Snapshot() {}
+
+const std::vector<lib::String>& Snapshot::get_variables() {
+    return variables;
+}
+
+const std::vector<lib::Value>& Snapshot::get_globals() {
+    return globals;
+}
+
+const std::vector<lib::Value>& Snapshot::get_constants() {
+    return constants;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "compiler.h"
+
+// The state a script leaves behind, saved so later runs can start from it instead of running the
+// script again: every variable's name and value, and the constant pool.
+//
+// File layout, native-endian, written once by write() and only ever mapped read-only afterwards:
+//      Header
+//      Record[variable_count]      variable names, always strings
+//      Record[variable_count]      global values, in the same order
+//      Record[constant_count]      constant pool
+//      char[string_bytes]          the characters of every string above, back to back
+class Snapshot {
+    public:
+        static constexpr char MAGIC[8] = {'L', 'O', 'X', 'S', 'N', 'A', 'P', '1'};
+
+    private:
+        struct Header {
+            char magic[8];
+            uint32_t variable_count;
+            uint32_t constant_count;
+            uint64_t string_bytes;
+        };
+
+        // A number, a bool, or a string stored as an offset into the string section
+        struct Record {
+            enum Tag : uint32_t { NUMBER, BOOL, STRING };
+            Tag tag;
+            uint32_t length;
+            uint64_t payload;
+        };
+
+        std::vector<lib::String> variables;
+        std::vector<lib::Value> globals;
+        std::vector<lib::Value> constants;
+
+    public:
+        explicit Snapshot(const std::string& path);
+        ~Snapshot();
+
+        static void write(const std::string& path, const Program& program, std::span<const lib::Value> globals);
+
+        const std::vector<lib::String>& get_variables();
+        const std::vector<lib::Value>& get_globals();
+        const std::vector<lib::Value>& get_constants();
+};
@@ -0,0 +1,162 @@
+#include "transpiler.h"
+
+// Ahead-of-time translation of bytecode to C++. Only verified programs are accepted: the Verifier
+// already proved every operand's type, so each instruction can be written out as one statement on
+// named locals, and reading a variable is just a reference to the local that defined it. Bytecode has
+// no jumps, so the output is a single straight-line main().
+
+// A C++ string literal holding exactly these bytes.
+static std::string quoted(std::string_view chars) {
+    std::string literal = "\"";
+    for (unsigned char c : chars) {
+        if (c == '"' || c == '\\') {
+            literal += '\\';
+            literal += static_cast<char>(c);
+        } else if (c < 0x20 || c >= 0x7F) {
+            // Octal escapes stop after three digits, unlike hex ones, so a following digit is safe
+            literal += std::format("\\{:03o}", c);
+        } else {
+            literal += static_cast<char>(c);
+        }
+    }
+    return literal + "\"";
+}
+
+Transpiler::Transpiler(const Program& program) : program(program) {}
+
+Transpiler::~Transpiler() {}
+
+bool Transpiler::transpile(std::ostream& out) {
+    Verifier verifier(program);
+    if (!verifier.verify()) return fail(0, "Only programs that pass the Verifier can be transpiled");
+
+    stack.clear();
+    globals.assign(program.variable_pool.size(), Slot{});
+    temporaries = 0;
+
+    std::ostringstream body;
+    const std::pmr::vector<uint8_t>& bytecode = program.bytecode;
+    for (size_t i = 0; i < bytecode.size(); i += op_length(bytecode[i])) {
+        if (!emit(i, body)) return false;
+    }
+
+    out << "// Generated by `interpreter transpile`.\n"
+        << "#include <iostream>\n"
+        << "#include <string>\n\n"
+        << "int main() {\n"
+        << "    std::ios::sync_with_stdio(false);\n"
+        << body.str()
+        << "    return 0;\n"
+        << "}\n";
+    return true;
+}
+
+bool Transpiler::emit(size_t offset, std::ostream& out) {
+    const std::pmr::vector<uint8_t>& bytecode = program.bytecode;
+    uint8_t op = bytecode[offset];
+
+    auto binary = [&](const char* symbol, Type result) {
+        Slot b = stack.back(); stack.pop_back();
+        Slot a = stack.back(); stack.pop_back();
+        stack.push_back(define(result, std::format("{} {} {}", a.name, symbol, b.name), out));
+    };
+    auto with_constant = [&](const char* symbol, Type result) {
+        Slot a = stack.back(); stack.pop_back();
+        Slot b = constant(bytecode[offset + 1], out);
+        stack.push_back(define(result, std::format("{} {} {}", a.name, symbol, b.name), out));
+    };
+    auto var_constant = [&](const char* symbol) {
+        const Slot& a = globals[bytecode[offset + 1]];
+        Slot b = constant(bytecode[offset + 2], out);
+        stack.push_back(define(Type::BOOL, std::format("{} {} {}", a.name, symbol, b.name), out));
+    };
+
+    switch (op)
+    {
+        case CON: stack.push_back(constant(bytecode[offset + 1], out)); break;
+        case VAR: stack.push_back(globals[bytecode[offset + 1]]); break;
+        case DEF: {
+            globals[bytecode[offset + 1]] = stack.back();
+            stack.pop_back();
+            break;
+        }
+        // Verified, so both operands share a type, and it's either numbers or strings
+        case ADD: case ADD_NUM: binary("+", stack.back().type); break;
+        case SUB: case SUB_NUM: binary("-", Type::NUMBER); break;
+        case MUL: case MUL_NUM: binary("*", Type::NUMBER); break;
+        case DIV: case DIV_NUM: binary("/", Type::NUMBER); break;
+        case GRT: case GRT_NUM: binary(">", Type::BOOL); break;
+        case GRTE: case GRTE_NUM: binary(">=", Type::BOOL); break;
+        case LSS: case LSS_NUM: binary("<", Type::BOOL); break;
+        case LSSE: case LSSE_NUM: binary("<=", Type::BOOL); break;
+        // The VM compares variants, so values of different types are never equal; both types are
+        // known here, which settles those comparisons before the generated code runs
+        case EQEQ: case BEQ: {
+            const char* symbol = op == EQEQ ? "==" : "!=";
+            if (stack.end()[-2].type == stack.back().type) {
+                binary(symbol, Type::BOOL);
+                break;
+            }
+            stack.pop_back();
+            stack.pop_back();
+            stack.push_back(define(Type::BOOL, op == EQEQ ? "false" : "true", out));
+            break;
+        }
+        case ADD_CONST: with_constant("+", stack.back().type); break;
+        case SUB_CONST: with_constant("-", Type::NUMBER); break;
+        case MUL_CONST: with_constant("*", Type::NUMBER); break;
+        case DIV_CONST: with_constant("/", Type::NUMBER); break;
+        case VAR_GRT_CONST: var_constant(">"); break;
+        case VAR_GRTE_CONST: var_constant(">="); break;
+        case VAR_LSS_CONST: var_constant("<"); break;
+        case VAR_LSSE_CONST: var_constant("<="); break;
+        case PRINT: {
+            print(stack.back(), out);
+            stack.pop_back();
+            break;
+        }
+        case PRINT_RETURN: {
+            print(stack.back(), out);
+            out << "    std::cout << '\\n';\n";
+            stack.clear();
+            break;
+        }
+        case RETURN: {
+            out << "    std::cout << '\\n';\n";
+            stack.clear();
+            break;
+        }
+        default: return fail(offset, "Opcode not supported by the transpiler");
+    }
+    return true;
+}
+
+Transpiler::Slot Transpiler::constant(uint8_t index, std::ostream& out) {
+    const lib::Value& value = program.constant_pool[index];
+    if (auto v = std::get_if<double>(&value)) return define(Type::NUMBER, std::format("{}", *v), out);
+    if (auto v = std::get_if<bool>(&value)) return define(Type::BOOL, *v ? "true" : "false", out);
+    return define(Type::STRING, quoted(std::get<lib::String>(value).str()), out);
+}
+
+// Declares a fresh local holding value.
+Transpiler::Slot Transpiler::define(Type type, const std::string& value, std::ostream& out) {
+    Slot slot{std::format("t{}", temporaries++), type};
+    const char* type_name = type == Type::NUMBER ? "double" : type == Type::STRING ? "std::string" : "bool";
+    out << std::format("    const {} {} = {};\n", type_name, slot.name, value);
+    return slot;
+}
+
+// Formats values the way the VM's PRINT does.
+void Transpiler::print(const Slot& slot, std::ostream& out) {
+    if (slot.type == Type::STRING) out << std::format("    std::cout << {};\n", slot.name);
+    else out << std::format("    std::cout << std::to_string({});\n", slot.name);
+}
+
+bool Transpiler::fail(size_t offset, const char* reason) {
+    error = std::format("[offset {}] {}", offset, reason);
+    return false;
+}
+
+const std::string& Transpiler::get_error() {
+    return error;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "compiler.h"
+#include "verifier.h"
+
+// Translates a verified Program into a standalone C++ translation unit that prints exactly what the
+// VM would. Every value the bytecode pushes becomes a typed local, so the generated code has no
+// stack, no dispatch and no variants left for the system compiler to see through.
+class Transpiler {
+    private:
+        enum class Type { NUMBER, STRING, BOOL };
+        struct Slot {
+            std::string name;
+            Type type;
+        };
+
+        const Program& program;
+        std::vector<Slot> stack;
+        std::vector<Slot> globals;
+        size_t temporaries = 0;
+        std::string error;
+
+        bool fail(size_t offset, const char* reason);
+        bool emit(size_t offset, std::ostream& out);
+        Slot constant(uint8_t index, std::ostream& out);
+        Slot define(Type type, const std::string& value, std::ostream& out);
+        void print(const Slot& slot, std::ostream& out);
+
+    public:
+        Transpiler(const Program& program);
+        ~Transpiler();
+
+        bool transpile(std::ostream& out);
+        const std::string& get_error();
+};
@@ -0,0 +1,181 @@
+#include "verifier.h"
+
+// Walks a Program's bytecode once, tracking the type of every stack slot and global, and proves that
+// every operand index is in range, the stack never underflows or outgrows max_stack, and every
+// operator gets operands of the type it needs. Bytecode has no jumps yet, so one linear pass covers
+// every path. A program that fails any check still runs, just through the VM's checked loop.
+//
+// The Verifier only holds references, so code appended to the program after a verify() can be
+// checked on its own with verify(from), starting from the globals' types the earlier code left.
+
+Verifier::Verifier(const Program& program)
+    : Verifier(program.bytecode, program.constant_pool, program.variable_pool, program.max_stack) {}
+
+Verifier::Verifier(const std::pmr::vector<uint8_t>& bytecode, const std::pmr::vector<lib::Value>& constant_pool,
+                   const std::pmr::vector<lib::String>& variable_pool, const size_t& max_stack)
+    : bytecode(bytecode), constant_pool(constant_pool), variable_pool(variable_pool), max_stack(max_stack) {}
+
+Verifier::~Verifier() {}
+
+// Checks bytecode[from, end). From 0 the globals start out undefined except for the bound inputs;
+// from anywhere else, from must be where the bytecode ended at the last call, and the globals keep
+// the types that call left them with. A failed check forgets the types of every global the
+// unchecked rest of the code could store to, since it may or may not get to run.
+bool Verifier::verify(size_t from) {
+    stack.clear();
+    // Inputs bound to variables the last call didn't know about yet are applied now
+    size_t known = from == 0 ? 0 : globals.size();
+    if (from == 0) globals.clear();
+    globals.resize(variable_pool.size());
+    for (auto [var_index, type] : inputs) {
+        if (var_index >= known && var_index < globals.size()) globals[var_index] = type;
+    }
+
+    if (scan(from)) return true;
+    for (size_t i = failed_at; i < bytecode.size() && i + op_length(bytecode[i]) <= bytecode.size(); i += op_length(bytecode[i])) {
+        if (bytecode[i] == DEF && bytecode[i + 1] < globals.size()) globals[bytecode[i + 1]] = std::nullopt;
+    }
+    return false;
+}
+
+bool Verifier::scan(size_t from) {
+    for (size_t i = from; i < bytecode.size(); i += op_length(bytecode[i]))
+    {
+        uint8_t op = bytecode[i];
+        if (i + op_length(op) > bytecode.size()) return fail(i, "Truncated instruction");
+
+        switch (op)
+        {
+            case CON: {
+                if (bytecode[i + 1] >= constant_pool.size()) return fail(i, "Constant index out of range");
+                stack.push_back(constant_type(bytecode[i + 1]));
+                break;
+            }
+            case VAR: {
+                uint8_t var_index = bytecode[i + 1];
+                if (var_index >= globals.size()) return fail(i, "Variable index out of range");
+                if (!globals[var_index]) return fail(i, "Variable read before its definition");
+                stack.push_back(*globals[var_index]);
+                break;
+            }
+            case DEF: {
+                uint8_t var_index = bytecode[i + 1];
+                if (var_index >= globals.size()) return fail(i, "Variable index out of range");
+                if (stack.empty()) return fail(i, "Stack underflow");
+                globals[var_index] = stack.back();
+                stack.pop_back();
+                break;
+            }
+            case ADD: {
+                if (stack.size() < 2) return fail(i, "Stack underflow");
+                Type b = stack.back(); stack.pop_back();
+                if (stack.back() != b || b == Type::BOOL) return fail(i, "Operands must be two numbers or two strings");
+                break;
+            }
+            case SUB: case MUL: case DIV:
+            case ADD_NUM: case SUB_NUM: case MUL_NUM: case DIV_NUM: {
+                if (!pop_number(i) || !pop_number(i)) return false;
+                stack.push_back(Type::NUMBER);
+                break;
+            }
+            case GRT: case GRTE: case LSS: case LSSE:
+            case GRT_NUM: case GRTE_NUM: case LSS_NUM: case LSSE_NUM: {
+                if (!pop_number(i) || !pop_number(i)) return false;
+                stack.push_back(Type::BOOL);
+                break;
+            }
+            case EQEQ: case BEQ: {
+                if (stack.size() < 2) return fail(i, "Stack underflow");
+                stack.pop_back();
+                stack.back() = Type::BOOL;
+                break;
+            }
+            case ADD_CONST: {
+                if (bytecode[i + 1] >= constant_pool.size()) return fail(i, "Constant index out of range");
+                if (stack.empty()) return fail(i, "Stack underflow");
+                Type b = constant_type(bytecode[i + 1]);
+                if (stack.back() != b || b == Type::BOOL) return fail(i, "Operands must be two numbers or two strings");
+                break;
+            }
+            case SUB_CONST: case MUL_CONST: case DIV_CONST: {
+                if (bytecode[i + 1] >= constant_pool.size()) return fail(i, "Constant index out of range");
+                if (constant_type(bytecode[i + 1]) != Type::NUMBER) return fail(i, "Operands must be numbers");
+                if (!pop_number(i)) return false;
+                stack.push_back(Type::NUMBER);
+                break;
+            }
+            case VAR_GRT_CONST: case VAR_GRTE_CONST: case VAR_LSS_CONST: case VAR_LSSE_CONST: {
+                uint8_t var_index = bytecode[i + 1];
+                if (var_index >= globals.size()) return fail(i, "Variable index out of range");
+                if (bytecode[i + 2] >= constant_pool.size()) return fail(i, "Constant index out of range");
+                if (globals[var_index] != Type::NUMBER || constant_type(bytecode[i + 2]) != Type::NUMBER) {
+                    return fail(i, "Operands must be numbers");
+                }
+                stack.push_back(Type::BOOL);
+                break;
+            }
+            case PRINT: {
+                if (stack.empty()) return fail(i, "Stack underflow");
+                stack.pop_back();
+                break;
+            }
+            case PRINT_RETURN: {
+                if (stack.empty()) return fail(i, "Stack underflow");
+                stack.clear();
+                break;
+            }
+            case RETURN: {
+                stack.clear();
+                break;
+            }
+            default: return fail(i, "Opcode not supported by the VM");
+        }
+
+        if (stack.size() > max_stack) return fail(i, "Stack deeper than max_stack");
+    }
+    return true;
+}
+
+// Treats a variable as a number that's already defined when the program starts, for globals the
+// caller fills in from outside the script.
+void Verifier::bind_number(size_t var_index) {
+    inputs.emplace_back(var_index, Type::NUMBER);
+}
+
+// Same, for a global that already holds value when the program starts.
+void Verifier::bind_value(size_t var_index, const lib::Value& value) {
+    inputs.emplace_back(var_index, type_of(value));
+}
+
+// Takes a global to hold value from now on, for the next verify(from). Lets a caller that ran code
+// which failed verification tell the Verifier what that code actually stored.
+void Verifier::assume_value(size_t var_index, const lib::Value& value) {
+    if (var_index < globals.size()) globals[var_index] = type_of(value);
+}
+
+bool Verifier::pop_number(size_t offset) {
+    if (stack.empty()) return fail(offset, "Stack underflow");
+    if (stack.back() != Type::NUMBER) return fail(offset, "Operands must be numbers");
+    stack.pop_back();
+    return true;
+}
+
+Verifier::Type Verifier::constant_type(uint8_t index) {
+    return type_of(constant_pool[index]);
+}
+
+Verifier::Type Verifier::type_of(const lib::Value& value) {
+    if (std::holds_alternative<double>(value)) return Type::NUMBER;
+    if (std::holds_alternative<bool>(value)) return Type::BOOL;
+    return Type::STRING;
+}
+
+bool Verifier::fail(size_t offset, const char* reason) {
+    failed_at = offset;
+    error = std::format("[offset {}] {}", offset, reason);
+    return false;
+}
+
+const std::string& Verifier::get_error() {
+    return error;
+}
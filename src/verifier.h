@@ -0,0 +1,40 @@
+#pragma once
+#include "libraries.h"
+#include "compiler.h"
+
+// Checks a Program once at load time so the VM can run it without per-instruction checks.
+class Verifier {
+    public:
+        static constexpr size_t NO_LIMIT = SIZE_MAX;
+
+    private:
+        enum class Type { NUMBER, STRING, BOOL };
+
+        const std::pmr::vector<uint8_t>& bytecode;
+        const std::pmr::vector<lib::Value>& constant_pool;
+        const std::pmr::vector<lib::String>& variable_pool;
+        const size_t& max_stack;
+        std::vector<Type> stack;
+        std::vector<std::optional<Type>> globals;
+        std::vector<std::pair<size_t, Type>> inputs;
+        size_t failed_at = 0;
+        std::string error;
+
+        bool scan(size_t from);
+        bool fail(size_t offset, const char* reason);
+        bool pop_number(size_t offset);
+        Type constant_type(uint8_t index);
+        static Type type_of(const lib::Value& value);
+
+    public:
+        Verifier(const Program& program);
+        Verifier(const std::pmr::vector<uint8_t>& bytecode, const std::pmr::vector<lib::Value>& constant_pool,
+                 const std::pmr::vector<lib::String>& variable_pool, const size_t& max_stack = NO_LIMIT);
+        ~Verifier();
+
+        void bind_number(size_t var_index);
+        void bind_value(size_t var_index, const lib::Value& value);
+        void assume_value(size_t var_index, const lib::Value& value);
+        bool verify(size_t from = 0);
+        const std::string& get_error();
+};
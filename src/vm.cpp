@@ -1,18 +1,27 @@
 #include "vm.h"
 
-VM::VM(const std::vector<uint8_t>& bytecode, std::vector<std::variant<double, std::string, bool>>& constant_pool,
-       const std::vector<std::string>& variable_pool, std::unordered_map<size_t, size_t>& variable_map) 
-    : bytecode(bytecode), constant_pool(constant_pool), variable_pool(variable_pool), variable_map(variable_map) {}
+// Runs the bytecode of a Program. Generic arithmetic and comparison instructions rewrite themselves
+// into their *_NUM form the first time they see two numbers, which skips the operand type dispatch
+// on later runs. A *_NUM instruction that meets anything else rewrites itself back and re-executes
+// as the generic instruction.
+// Programs that pass the Verifier run through run<false> instead, which assumes operand types and
+// bounds were proven at load time and neither checks nor rewrites anything.
+
+VM::VM(Program& program, size_t gc_threshold, double gc_growth_factor)
+    : program(program), bytecode(program.bytecode), constant_pool(program.constant_pool), variable_pool(program.variable_pool),
+      globals(program.variable_pool.size(), program.bytecode.get_allocator()),
+      defined(program.variable_pool.size(), program.bytecode.get_allocator()), stack(program.bytecode.get_allocator()),
+      heap(gc_threshold, gc_growth_factor) {}
 
 VM::~VM() {}
 
-void print_value(const std::variant<double, std::string, bool>& v) {
+void print_value(const lib::Value& v) {
     std::visit([](auto&& val){
         std::cout << val;
     }, v);
 }
 
-void print_stack(const std::vector<std::variant<double, std::string, bool>>& stack) {
+void print_stack(const std::vector<lib::Value>& stack) {
     for (const auto& v : stack) {
         print_value(v);
         std::cout << " ";
@@ -20,143 +29,414 @@ void print_stack(const std::vector<std::variant<double, std::string, bool>>& sta
     std::cout << "\n";
 }
 
-void VM::execute() {
-    std::vector<std::variant<double, std::string, bool>> stack;
-    bool store_var = false;
-    for (size_t i = 0; i < bytecode.size(); i++)
+// Reads the two topmost stack values as numbers, leaving the stack untouched.
+template <bool checked>
+static bool peek_numbers(const lib::Value* sp, double& a, double& b) {
+    const double* pa = std::get_if<double>(&sp[-2]);
+    const double* pb = std::get_if<double>(&sp[-1]);
+    if constexpr (!checked) { [[assume(pa && pb)]]; }
+    if (!pa || !pb) return false;
+    a = *pa;
+    b = *pb;
+    return true;
+}
+
+static void print_top(std::ostream& out, lib::Value*& sp) {
+    const lib::Value& literal = *--sp;
+    if (auto v = std::get_if<lib::String>(&literal)) {
+        out << *v;
+    } else if (auto v = std::get_if<double>(&literal)){
+        out << std::to_string(*v);
+    } else if (auto v = std::get_if<bool>(&literal)) {
+        out << std::to_string(*v);
+    }
+}
+
+// Returns the number on top of the stack for a *_CONST superinstruction to update in place,
+// loading its constant operand into b.
+template <bool checked>
+static double& const_operands(lib::Value* sp, const lib::Value& constant, double& b) {
+    double* a = std::get_if<double>(&sp[-1]);
+    const double* pb = std::get_if<double>(&constant);
+    if constexpr (!checked) { [[assume(a && pb)]]; }
+    if (!a || !pb) throw std::runtime_error("Operands must be numbers.");
+    b = *pb;
+    return *a;
+}
+
+// Loads the variable and constant operands of a VAR_*_CONST superinstruction as numbers.
+template <bool checked>
+static void var_const_operands(const lib::Value& var, const lib::Value& constant, double& a, double& b) {
+    const double* pa = std::get_if<double>(&var);
+    const double* pb = std::get_if<double>(&constant);
+    if constexpr (!checked) { [[assume(pa && pb)]]; }
+    if (!pa || !pb) throw std::runtime_error("Operands must be numbers.");
+    a = *pa;
+    b = *pb;
+}
+
+// Concatenates the string b onto the string in a. Returns false if either isn't a string.
+static bool concat_strings(Heap& heap, lib::Value& a, const lib::Value& b) {
+    lib::String* sa = std::get_if<lib::String>(&a);
+    const lib::String* sb = std::get_if<lib::String>(&b);
+    if (!sa || !sb) return false;
+    *sa = heap.concat(*sa, *sb);
+    return true;
+}
+
+// Programs that failed verification may not keep to the stack max_stack was computed for, so the
+// checked loop tests every instruction against the stack's bounds before running it.
+void VM::check_stack(uint8_t op, size_t depth) {
+    if (depth < operand_count(op)) throw std::runtime_error("Stack underflow.");
+    if (stack_effect(op) > 0 && depth + stack_effect(op) > stack.size()) throw std::runtime_error("Stack overflow.");
+}
+
+// Nor are its operands known to index the pools, or its variables to have been defined before they're read.
+void VM::check_operands(size_t offset) {
+    uint8_t op = bytecode[offset];
+    if (offset + op_length(op) > bytecode.size()) throw std::runtime_error("Truncated instruction.");
+    auto constant = [&](size_t index) {
+        if (index >= constant_pool.size()) throw std::runtime_error("Constant index out of range.");
+    };
+    auto variable = [&](size_t index, bool read) {
+        if (index >= globals.size()) throw std::runtime_error("Variable index out of range.");
+        if (read && !defined[index]) {
+            throw std::runtime_error(std::format("Undefined variable '{}'.", variable_pool[index].str()));
+        }
+    };
+    switch (op) {
+        case CON: case ADD_CONST: case SUB_CONST: case MUL_CONST: case DIV_CONST:
+            constant(bytecode[offset + 1]);
+            break;
+        case VAR: variable(bytecode[offset + 1], true); break;
+        case DEF: variable(bytecode[offset + 1], false); break;
+        case VAR_GRT_CONST: case VAR_GRTE_CONST: case VAR_LSS_CONST: case VAR_LSSE_CONST:
+            variable(bytecode[offset + 1], true);
+            constant(bytecode[offset + 2]);
+            break;
+        default: break;
+    }
+}
+
+static uint8_t quickened(uint8_t op) {
+    switch (op) {
+        case SUB: return SUB_NUM;
+        case MUL: return MUL_NUM;
+        case DIV: return DIV_NUM;
+        case GRT: return GRT_NUM;
+        case GRTE: return GRTE_NUM;
+        case LSS: return LSS_NUM;
+        case LSSE: return LSSE_NUM;
+        default: return op;
+    }
+}
+
+// Everything the running script can still reach: the live part of the stack, globals and constants.
+// Only called between instructions, when every value in flight is on the stack.
+void VM::collect_garbage(const lib::Value* stack_begin, const lib::Value* sp) {
+    for (const lib::Value* v = stack_begin; v < sp; v++) heap.mark(*v);
+    for (const lib::Value& v : globals) heap.mark(v);
+    for (const lib::Value& v : constant_pool) heap.mark(v);
+    heap.collect();
+}
+
+Heap& VM::get_heap() {
+    return heap;
+}
+
+// Runs the program from the given offset to the end. Globals and the heap carry over between calls,
+// so code appended to the program later can run against the state left by what ran before.
+void VM::execute(size_t from) {
+    start(from);
+    resume(SIZE_MAX);
+}
+
+// Prepares a run from the given offset without executing anything; resume() then runs it in slices.
+// A run from where the last one ended, as a REPL does for each line, only verifies the new code.
+void VM::start(size_t from) {
+    globals.resize(variable_pool.size());
+    defined.resize(variable_pool.size());
+    // Sized once from the depth the compiler worked out, so pushes never reallocate
+    stack.resize(program.max_stack);
+    if (from == 0 || !verifier) {
+        verifier.emplace(program);
+        for (size_t v = 0; v < preset; v++) verifier->bind_value(v, globals[v]);
+        verified = verifier->verify();
+    } else {
+        // The last run's code ran checked, so what it stored is only known from the globals themselves
+        if (!verified) {
+            for (size_t i = started; i < from; i += op_length(bytecode[i])) {
+                if (bytecode[i] == DEF && defined[bytecode[i + 1]]) verifier->assume_value(bytecode[i + 1], globals[bytecode[i + 1]]);
+            }
+        }
+        verified = verifier->verify(from);
+    }
+    started = from;
+    pc = from;
+    depth = 0;
+}
+
+// Runs at most budget instructions of the current run and returns whether it reached the end.
+bool VM::resume(size_t budget) {
+    if (verified) profiled ? run<false, true>(budget) : run<false, false>(budget);
+    else profiled ? run<true, true>(budget) : run<true, false>(budget);
+    return finished();
+}
+
+bool VM::finished() {
+    return pc >= bytecode.size();
+}
+
+// Instructions executed over the VM's lifetime, across every run and slice.
+uint64_t VM::get_instructions() {
+    return instructions;
+}
+
+void VM::set_output(std::ostream& output) {
+    out = &output;
+}
+
+const std::pmr::vector<lib::Value>& VM::get_globals() {
+    return globals;
+}
+
+// Starts the first values.size() globals off with these values, e.g. from a snapshot. Strings among
+// them must be interned, since this VM's heap doesn't own them.
+void VM::load_globals(std::span<const lib::Value> values) {
+    if (values.size() > variable_pool.size()) throw std::runtime_error("More globals than the program has variables.");
+    globals.resize(variable_pool.size());
+    defined.resize(variable_pool.size());
+    std::copy(values.begin(), values.end(), globals.begin());
+    std::fill(defined.begin(), defined.begin() + values.size(), true);
+    preset = values.size();
+}
+
+// When enabled, every instruction stores its offset in ip before running, which costs one relaxed
+// store per instruction, so it's compiled out of the unprofiled loop.
+void VM::set_profiled(bool enabled) {
+    profiled = enabled;
+}
+
+const std::atomic<size_t>& VM::get_ip() {
+    return ip;
+}
+
+template <bool checked, bool sampled>
+void VM::run(size_t budget) {
+    lib::Value* sp = stack.data() + depth;
+    size_t remaining = budget;
+    size_t i = pc;
+
+    // Records where the slice stopped on the way out, including when an instruction throws
+    struct Suspend {
+        VM& vm;
+        const size_t& i;
+        lib::Value* const& sp;
+        const size_t& remaining;
+        size_t budget;
+
+        ~Suspend() {
+            vm.pc = i;
+            vm.depth = static_cast<size_t>(sp - vm.stack.data());
+            vm.instructions += budget - remaining;
+            if constexpr (sampled) vm.ip.store(NOT_RUNNING, std::memory_order_relaxed);
+        }
+    } suspend{*this, i, sp, remaining, budget};
+
+    for (; i < bytecode.size() && remaining; i++, remaining--)
     {
+        if constexpr (sampled) ip.store(i, std::memory_order_relaxed);
+        if constexpr (checked) {
+            check_stack(bytecode[i], static_cast<size_t>(sp - stack.data()));
+            check_operands(i);
+        }
         switch (bytecode[i])
         {
             case CON: {
                 uint8_t index = bytecode[++i];
-                stack.push_back(constant_pool[index]);
+                *sp++ = constant_pool[index];
                 break;
             }
             case ADD: {
-                auto b = stack.back(); stack.pop_back();
-                auto a = stack.back(); stack.pop_back();
-                constant_pool.push_back(std::get<double>(a) + std::get<double>(b));
-                if (bytecode[i+1] == VAR) {
-                    store_var = true;
-                    stack.push_back(static_cast<double>(constant_pool.size() - 1));
-                } else {
-                    stack.push_back(std::get<double>(constant_pool.back()));
+                // Strings are legal here even in verified programs, so the type is always checked
+                double a, b;
+                if (peek_numbers<true>(sp, a, b)) {
+                    if constexpr (checked) bytecode[i] = ADD_NUM;
+                    sp[-2] = a + b;
+                } else if (!concat_strings(heap, sp[-2], sp[-1])) {
+                    throw std::runtime_error("Operands must be two numbers or two strings.");
                 }
+                --sp;
+                if (heap.should_collect()) collect_garbage(stack.data(), sp);
                 break;
             }
-            case SUB: {
-                auto b = stack.back(); stack.pop_back();
-                auto a = stack.back(); stack.pop_back();
-                constant_pool.push_back(std::get<double>(a) - std::get<double>(b));
-                if (bytecode[i+1] == VAR) {
-                    store_var = true;
-                    stack.push_back(static_cast<double>(constant_pool.size() - 1));
-                } else {
-                    stack.push_back(std::get<double>(constant_pool.back()));
+            case SUB: case MUL: case DIV:
+            case GRT: case GRTE: case LSS: case LSSE: {
+                double a, b;
+                if (!peek_numbers<checked>(sp, a, b)) throw std::runtime_error("Operands must be numbers.");
+                uint8_t op = bytecode[i];
+                if constexpr (checked) bytecode[i] = quickened(op);
+                switch (op) {
+                    case SUB: sp[-2] = a - b; break;
+                    case MUL: sp[-2] = a * b; break;
+                    case DIV: sp[-2] = a / b; break;
+                    case GRT: sp[-2] = a > b; break;
+                    case GRTE: sp[-2] = a >= b; break;
+                    case LSS: sp[-2] = a < b; break;
+                    case LSSE: sp[-2] = a <= b; break;
                 }
+                --sp;
                 break;
             }
-            case MUL: {
-                auto b = stack.back(); stack.pop_back();
-                auto a = stack.back(); stack.pop_back();
-                constant_pool.push_back(std::get<double>(a) * std::get<double>(b));
-                if (bytecode[i+1] == VAR) {
-                    store_var = true;
-                    stack.push_back(static_cast<double>(constant_pool.size() - 1));
-                } else {
-                    stack.push_back(std::get<double>(constant_pool.back()));
-                }
+            case EQEQ: case BEQ: {
+                // Values of different types are never equal
+                bool equal = sp[-2] == sp[-1];
+                sp[-2] = bytecode[i] == EQEQ ? equal : !equal;
+                --sp;
                 break;
             }
-            case DIV: {
-                auto b = stack.back(); stack.pop_back();
-                auto a = stack.back(); stack.pop_back();
-                constant_pool.push_back(std::get<double>(a) / std::get<double>(b));
-                if (bytecode[i+1] == VAR) {
-                    store_var = true;
-                    stack.push_back(static_cast<double>(constant_pool.size() - 1));
-                } else {
-                    stack.push_back(std::get<double>(constant_pool.back()));
-                }
+            case ADD_NUM: {
+                double a, b;
+                if (!peek_numbers<checked>(sp, a, b)) { bytecode[i--] = ADD; break; }
+                sp[-2] = a + b;
+                --sp;
                 break;
             }
-            case GRT: {
-                auto b = stack.back(); stack.pop_back();
-                auto a = stack.back(); stack.pop_back();
-                constant_pool.push_back(std::get<double>(a) > std::get<double>(b));
-                if (bytecode[i+1] == VAR) {
-                    store_var = true;
-                    stack.push_back(static_cast<double>(constant_pool.size() - 1));
-                } else {
-                    stack.push_back(std::get<double>(constant_pool.back()));
-                }
+            case SUB_NUM: {
+                double a, b;
+                if (!peek_numbers<checked>(sp, a, b)) { bytecode[i--] = SUB; break; }
+                sp[-2] = a - b;
+                --sp;
                 break;
             }
-            case GRTE: {
-                auto b = stack.back(); stack.pop_back();
-                auto a = stack.back(); stack.pop_back();
-                constant_pool.push_back(std::get<double>(a) >= std::get<double>(b));
-                if (bytecode[i+1] == VAR) {
-                    store_var = true;
-                    stack.push_back(static_cast<double>(constant_pool.size() - 1));
-                } else {
-                    stack.push_back(std::get<double>(constant_pool.back()));
-                }
+            case MUL_NUM: {
+                double a, b;
+                if (!peek_numbers<checked>(sp, a, b)) { bytecode[i--] = MUL; break; }
+                sp[-2] = a * b;
+                --sp;
                 break;
             }
-            case LSS: {
-                auto b = stack.back(); stack.pop_back();
-                auto a = stack.back(); stack.pop_back();
-                constant_pool.push_back(std::get<double>(a) < std::get<double>(b));
-                if (bytecode[i+1] == VAR) {
-                    store_var = true;
-                    stack.push_back(static_cast<double>(constant_pool.size() - 1));
-                } else {
-                    stack.push_back(std::get<double>(constant_pool.back()));
-                }
+            case DIV_NUM: {
+                double a, b;
+                if (!peek_numbers<checked>(sp, a, b)) { bytecode[i--] = DIV; break; }
+                sp[-2] = a / b;
+                --sp;
                 break;
             }
-            case LSSE: {
-                auto b = stack.back(); stack.pop_back();
-                auto a = stack.back(); stack.pop_back();
-                constant_pool.push_back(std::get<double>(a) <= std::get<double>(b));
-                if (bytecode[i+1] == VAR) {
-                    store_var = true;
-                    stack.push_back(static_cast<double>(constant_pool.size() - 1));
-                } else {
-                    stack.push_back(std::get<double>(constant_pool.back()));
-                }
+            case GRT_NUM: {
+                double a, b;
+                if (!peek_numbers<checked>(sp, a, b)) { bytecode[i--] = GRT; break; }
+                sp[-2] = a > b;
+                --sp;
+                break;
+            }
+            case GRTE_NUM: {
+                double a, b;
+                if (!peek_numbers<checked>(sp, a, b)) { bytecode[i--] = GRTE; break; }
+                sp[-2] = a >= b;
+                --sp;
+                break;
+            }
+            case LSS_NUM: {
+                double a, b;
+                if (!peek_numbers<checked>(sp, a, b)) { bytecode[i--] = LSS; break; }
+                sp[-2] = a < b;
+                --sp;
+                break;
+            }
+            case LSSE_NUM: {
+                double a, b;
+                if (!peek_numbers<checked>(sp, a, b)) { bytecode[i--] = LSSE; break; }
+                sp[-2] = a <= b;
+                --sp;
+                break;
+            }
+            case ADD_CONST: {
+                const lib::Value& constant = constant_pool[bytecode[++i]];
+                double* a = std::get_if<double>(&sp[-1]);
+                const double* b = std::get_if<double>(&constant);
+                if (a && b) *a += *b;
+                else if (!concat_strings(heap, sp[-1], constant)) throw std::runtime_error("Operands must be two numbers or two strings.");
+                if (heap.should_collect()) collect_garbage(stack.data(), sp);
+                break;
+            }
+            case SUB_CONST: {
+                double b;
+                double& a = const_operands<checked>(sp, constant_pool[bytecode[++i]], b);
+                a -= b;
+                break;
+            }
+            case MUL_CONST: {
+                double b;
+                double& a = const_operands<checked>(sp, constant_pool[bytecode[++i]], b);
+                a *= b;
+                break;
+            }
+            case DIV_CONST: {
+                double b;
+                double& a = const_operands<checked>(sp, constant_pool[bytecode[++i]], b);
+                a /= b;
+                break;
+            }
+            case VAR_GRT_CONST: {
+                double a, b;
+                var_const_operands<checked>(globals[bytecode[i + 1]], constant_pool[bytecode[i + 2]], a, b);
+                *sp++ = a > b;
+                i += 2;
+                break;
+            }
+            case VAR_GRTE_CONST: {
+                double a, b;
+                var_const_operands<checked>(globals[bytecode[i + 1]], constant_pool[bytecode[i + 2]], a, b);
+                *sp++ = a >= b;
+                i += 2;
+                break;
+            }
+            case VAR_LSS_CONST: {
+                double a, b;
+                var_const_operands<checked>(globals[bytecode[i + 1]], constant_pool[bytecode[i + 2]], a, b);
+                *sp++ = a < b;
+                i += 2;
+                break;
+            }
+            case VAR_LSSE_CONST: {
+                double a, b;
+                var_const_operands<checked>(globals[bytecode[i + 1]], constant_pool[bytecode[i + 2]], a, b);
+                *sp++ = a <= b;
+                i += 2;
                 break;
             }
             case PRINT: {
-                auto literal = stack.back(); stack.pop_back();
-                if (auto v = std::get_if<std::string>(&literal)) {
-                    print_value(*v);
-                } else if (auto v = std::get_if<double>(&literal)){
-                    print_value(std::to_string(*v));
-                } else if (auto v = std::get_if<bool>(&literal)) {
-                    print_value(std::to_string(*v));
-                }
+                print_top(*out, sp);
+                break;
+            }
+            case PRINT_RETURN: {
+                print_top(*out, sp);
+                *out << "\n";
+                sp = stack.data();
                 break;
             }
             case VAR: {
-                if (store_var) {
-                    auto index =  stack.back(); stack.pop_back();
-                    variable_map[bytecode[i+1]] = static_cast<size_t>(std::get<double>(index));
-                    store_var = false;
-                }
                 uint8_t var_index = bytecode[++i];
-                uint8_t con_index = variable_map.at(static_cast<size_t>(var_index));
-                stack.push_back(constant_pool[con_index]);
+                *sp++ = globals[var_index];
+                break;
+            }
+            case DEF: {
+                uint8_t var_index = bytecode[++i];
+                globals[var_index] = *--sp;
+                defined[var_index] = true;
                 break;
             }
             case RETURN: {
-                //print_value(stack.back());
-                std::cout << "\n";
+                //print_value(sp[-1]);
+                *out << "\n";
+                sp = stack.data();
+                break;
+            }
+            default: {
+                if constexpr (checked) throw std::runtime_error("Opcode not supported by the VM.");
                 break;
             }
-            default: break;
         }
-    }   
+    }
 }
-
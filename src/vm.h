@@ -1,17 +1,57 @@
 #pragma once
 #include "compiler.h"
+#include "verifier.h"
+#include "gc.h"
+#include <atomic>
 
 class VM {
     private:
-        const std::vector<uint8_t>& bytecode;
-        std::vector<std::variant<double, std::string, bool>>& constant_pool;
-        const std::vector<std::string>& variable_pool;
-        std::unordered_map<size_t, size_t>& variable_map;
+        Program& program;
+        std::pmr::vector<uint8_t>& bytecode;
+        std::pmr::vector<lib::Value>& constant_pool;
+        const std::pmr::vector<lib::String>& variable_pool;
+        std::pmr::vector<lib::Value> globals;
+        // Whether each global has been given a value, since an unset one still reads as 0.0
+        std::pmr::vector<bool> defined;
+        // Execution state kept between slices, so a run can stop after any instruction and resume
+        std::pmr::vector<lib::Value> stack;
+        size_t pc = 0;
+        size_t depth = 0;
+        uint64_t instructions = 0;
+        // Globals [0, preset) were given values before the program started
+        size_t preset = 0;
+        std::ostream* out = &std::cout;
+        // Kept between runs, so a run from a later offset only verifies the code added since
+        std::optional<Verifier> verifier;
+        size_t started = 0;
+        bool verified = false;
+        bool profiled = false;
+        // Offset of the instruction being run, published for a sampling profiler
+        std::atomic<size_t> ip{NOT_RUNNING};
+        Heap heap;
+
+        template <bool checked, bool sampled>
+        void run(size_t budget);
+        void collect_garbage(const lib::Value* stack_begin, const lib::Value* sp);
+        void check_stack(uint8_t op, size_t depth);
+        void check_operands(size_t offset);
 
     public:
-        VM(const std::vector<uint8_t>& bytecode, std::vector<std::variant<double, std::string, bool>>& constant_pool,
-           const std::vector<std::string>& variable_pool, std::unordered_map<size_t, size_t>& variable_map);
+        static constexpr size_t NOT_RUNNING = SIZE_MAX;
+
+        VM(Program& program, size_t gc_threshold = Heap::DEFAULT_THRESHOLD,
+           double gc_growth_factor = Heap::DEFAULT_GROWTH_FACTOR);
         ~VM();
 
-        void execute();
-};
\ No newline at end of file
+        void execute(size_t from = 0);
+        void start(size_t from = 0);
+        bool resume(size_t budget);
+        bool finished();
+        uint64_t get_instructions();
+        void set_output(std::ostream& output);
+        const std::pmr::vector<lib::Value>& get_globals();
+        void load_globals(std::span<const lib::Value> values);
+        Heap& get_heap();
+        void set_profiled(bool enabled);
+        const std::atomic<size_t>& get_ip();
+};
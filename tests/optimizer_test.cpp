@@ -0,0 +1,179 @@
+#include "compiler.h"
+#include "parser.h"
+#include "vm.h"
+#include <chrono>
+
+// Runs scripts with and without the compiler's optimizations and checks that both print the same
+// thing, down to the error a failing statement throws. Every optimized case must also compile to
+// different bytecode, or it isn't exercising the pass it's named after.
+
+namespace {
+    int failures = 0;
+
+    void expect(bool condition, std::string_view name, const std::string& detail) {
+        if (condition) return;
+        std::cerr << "FAIL " << name << ": " << detail << std::endl;
+        failures++;
+    }
+
+    // Variables in declared are known to the compiler before the script, as batch inputs are
+    Program compile(std::string_view source, bool optimize, std::initializer_list<std::string_view> declared = {}) {
+        Compiler compiler;
+        compiler.set_optimize(optimize);
+        for (std::string_view name : declared) compiler.add_variable(lib::intern(name));
+        return compile_program(source, compiler);
+    }
+
+    std::string run(Program& program, std::span<const lib::Value> presets = {}) {
+        std::ostringstream output;
+        VM vm(program);
+        vm.set_output(output);
+        vm.load_globals(presets);
+        try {
+            vm.execute();
+        } catch (const std::exception& e) {
+            output << "error: " << e.what();
+        }
+        return output.str();
+    }
+
+    // Feeds the lines to one Compiler and VM the way the REPL does, finishing and running each line on
+    // its own, so every pass only sees the code added since the last line
+    std::string session(std::initializer_list<std::string_view> lines, bool optimize, Program& program,
+                        std::initializer_list<std::string_view> declared = {}, std::span<const lib::Value> presets = {}) {
+        std::ostringstream output;
+        Compiler compiler;
+        compiler.set_optimize(optimize);
+        for (std::string_view name : declared) compiler.add_variable(lib::intern(name));
+        compiler.finish();
+        compiler.link(program);
+        VM vm(program);
+        vm.set_output(output);
+        vm.load_globals(presets);
+        for (std::string_view line : lines) {
+            Lexer lexer;
+            lexer.start(line);
+            Parser parser(lexer);
+            while (ExprPtr stmt = parser.next_statement()) compiler.compile_statement(stmt.get());
+            size_t start = program.bytecode.size();
+            compiler.finish();
+            compiler.link(program);
+            try {
+                vm.execute(start);
+            } catch (const std::exception& e) {
+                output << "error: " << e.what() << "\n";
+            }
+        }
+        return output.str();
+    }
+
+    void equivalent(std::string_view name, std::string_view source) {
+        Program plain = compile(source, false);
+        Program optimized = compile(source, true);
+        expect(plain.bytecode != optimized.bytecode, name, "optimizations changed nothing");
+        std::string expected = run(plain);
+        std::string actual = run(optimized);
+        expect(expected == actual, name, "printed\n" + actual + "\ninstead of\n" + expected);
+    }
+}
+
+int main() {
+    equivalent("dead stores and common subexpressions",
+        "var a = 3;\n"
+        "var b = 4;\n"
+        "var x = 1;\n"
+        "var x = 2;\n"
+        "var x = a * b + 1;\n"
+        "print(a * b + a * b + 7);\n"
+        "print((a * b + a * b) * 2);\n"
+        "print((a - b) * (a - b) + (a - b));\n"
+        "var a = 10;\n"
+        "print(a * b + a * b);\n"
+        "print(x);\n");
+
+    equivalent("superinstructions",
+        "var a = 5;\n"
+        "print(a > 3);\n"
+        "print(a >= 6);\n"
+        "print(a < 5);\n"
+        "print(a <= 5);\n"
+        "print(a + 1);\n"
+        "print(a * 2 - 1);\n"
+        "print(a / 4);\n"
+        "var s = \"ab\";\n"
+        "print(s + \"c\");\n");
+
+    // Equality leaves one value where it took two; counted wrong, the stack was sized too small
+    equivalent("equality",
+        "print(1 == 1);\n"
+        "print(\"a\" == \"a\");\n"
+        "print(1 == \"1\");\n"
+        "var s = \"ab\";\n"
+        "print(s == \"ab\");\n"
+        "print((1 != 2) != (3 != 4));\n"
+        "print(1 != 2);\n");
+    equivalent("equality overflow", "print(1); print((1 != 2) + (3 != 4) + (5 != 6) + (7 != 8));\n");
+
+    // w is declared but never defined, so the program fails verification and runs checked. The first
+    // run quickens x + y and x * 2 for numbers; the second meets strings there and has to deoptimize.
+    {
+        std::string_view source = "print(x + y); print(x * 2); print(w);\n";
+        const lib::Value numbers[] = {1.0, 2.0};
+        const lib::Value strings[] = {lib::intern("a"), lib::intern("b")};
+        Program plain = compile(source, false, {"x", "y", "w"});
+        Program optimized = compile(source, true, {"x", "y", "w"});
+        expect(plain.bytecode != optimized.bytecode, "quickening", "optimizations changed nothing");
+
+        std::string first = run(optimized, numbers);
+        expect(first == run(plain, numbers), "quickening", "printed\n" + first);
+        bool quickened = false;
+        for (size_t i = 0; i < optimized.bytecode.size(); i += op_length(optimized.bytecode[i])) {
+            quickened |= optimized.bytecode[i] == ADD_NUM;
+        }
+        expect(quickened, "quickening", "the first run left ADD generic");
+
+        Program fresh = compile(source, false, {"x", "y", "w"});
+        std::string second = run(optimized, strings);
+        expect(second == run(fresh, strings), "deoptimization", "printed\n" + second);
+    }
+
+    // The compiler doesn't know what type the declared w has, so the first line fails verification
+    // at print(w) but runs fine, storing a string to n. n must then count as unknown rather than the
+    // number the line's first store left: n * 3 throws, so the second line isn't pure and its first
+    // store to z can't be dropped as dead.
+    {
+        std::initializer_list<std::string_view> lines = {
+            "var n = 1; print(w); var n = \"s\";",
+            "var z = n * 3; var z = 4; print(z);",
+            "var a = 5; var a = 6; print(a * a + a * a);",
+        };
+        const lib::Value presets[] = {lib::intern("w")};
+        Program plain, optimized;
+        std::string expected = session(lines, false, plain, {"w"}, presets);
+        std::string actual = session(lines, true, optimized, {"w"}, presets);
+        expect(plain.bytecode != optimized.bytecode, "stores after a failed check", "optimizations changed nothing");
+        expect(expected == actual, "stores after a failed check", "printed\n" + actual + "\ninstead of\n" + expected);
+    }
+
+    // Value numbering keeps CSE linear in the length of the expression; keyed by the bytes of each
+    // subexpression, a chain this long exhausted memory
+    {
+        std::string source = "var a = 3; var b = 4; print(a * b";
+        for (int i = 0; i < 3000; i++) source += " + a * b";
+        source += ");\n";
+        auto begin = std::chrono::steady_clock::now();
+        Program optimized = compile(source, true);
+        auto elapsed = std::chrono::steady_clock::now() - begin;
+        Program plain = compile(source, false);
+        expect(elapsed < std::chrono::seconds(1), "long chain",
+            std::format("took {} ms to compile", std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()));
+        expect(optimized.bytecode.size() < plain.bytecode.size(), "long chain", "common subexpressions weren't shared");
+        std::string expected = run(plain);
+        std::string actual = run(optimized);
+        expect(expected == actual, "long chain", "printed\n" + actual + "\ninstead of\n" + expected);
+    }
+
+    if (failures) return EXIT_FAILURE;
+    std::cout << "optimizer: all equivalent" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,80 @@
+#include "compiler.h"
+#include "transpiler.h"
+#include "vm.h"
+#include <filesystem>
+#include <fstream>
+
+// Transpiles scripts, builds the generated C++ with the compiler that built this test, and checks the
+// binary prints what the VM prints for the same Program.
+
+namespace {
+    int failures = 0;
+
+    void expect(bool condition, std::string_view name, const std::string& detail) {
+        if (condition) return;
+        std::cerr << "FAIL " << name << ": " << detail << std::endl;
+        failures++;
+    }
+
+    std::string slurp(const std::filesystem::path& path) {
+        std::ifstream file(path, std::ios::binary);
+        return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    }
+
+    void equivalent(std::string_view name, std::string_view source) {
+        Program program = compile_program(source);
+        std::ostringstream expected;
+        VM vm(program);
+        vm.set_output(expected);
+        vm.execute();
+
+        std::ostringstream generated;
+        Transpiler transpiler(program);
+        if (!transpiler.transpile(generated)) {
+            expect(false, name, transpiler.get_error());
+            return;
+        }
+
+        std::filesystem::path dir = std::filesystem::temp_directory_path();
+        std::filesystem::path cpp = dir / "transpiler_test.cpp";
+        std::filesystem::path binary = dir / "transpiler_test.out";
+        std::filesystem::path output = dir / "transpiler_test.txt";
+        std::ofstream(cpp) << generated.str();
+        std::string build = std::format("\"{}\" -std=c++20 -o \"{}\" \"{}\"", TRANSPILER_CXX, binary.string(), cpp.string());
+        if (std::system(build.c_str()) != 0) {
+            expect(false, name, "generated code didn't compile:\n" + generated.str());
+            return;
+        }
+        std::string run = std::format("\"{}\" > \"{}\"", binary.string(), output.string());
+        expect(std::system(run.c_str()) == 0, name, "generated binary failed");
+        std::string actual = slurp(output);
+        expect(expected.str() == actual, name, "printed\n" + actual + "\ninstead of\n" + expected.str());
+    }
+}
+
+int main() {
+    equivalent("arithmetic",
+        "var a = 3;\n"
+        "var b = 4;\n"
+        "print(a * b + 1);\n"
+        "print(a > 2);\n"
+        "var s = \"x\";\n"
+        "print(s + \"y\");\n");
+
+    // Equality is the one operator that takes operands of different types
+    equivalent("equality",
+        "var a = 3;\n"
+        "var s = \"ab\";\n"
+        "print(a == 3);\n"
+        "print(a != 3);\n"
+        "print(s == \"ab\");\n"
+        "print(s != \"cd\");\n"
+        "print(a == s);\n"
+        "print(a != s);\n"
+        "print((a > 2) == (a < 2));\n"
+        "print((1 != 2) != (3 != 4));\n");
+
+    if (failures) return EXIT_FAILURE;
+    std::cout << "transpiler: all equivalent" << std::endl;
+    return EXIT_SUCCESS;
+}